@@ -0,0 +1,125 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "pr.h"
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/moduleparam.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/types.h>
+
+#include "calibration.h"
+#include "ec.h"
+#include "sampler.h"
+
+/* ========================================================================== */
+
+#define CALIBRATION_MAX_SAMPLES 256U
+#define CALIBRATION_TIME_LIMIT_NS (200 * NSEC_PER_MSEC)
+
+/* the sampler should keep the EC busy for at most 1/SAMPLER_DUTY_CYCLE_INV of the time */
+#define SAMPLER_DUTY_CYCLE_INV 100
+
+/* ========================================================================== */
+
+static bool nocalibration;
+module_param(nocalibration, bool, 0444);
+MODULE_PARM_DESC(nocalibration, "do not measure the EC transaction latency at load (default=false)");
+
+static unsigned int calibration_samples = 32;
+module_param(calibration_samples, uint, 0444);
+MODULE_PARM_DESC(calibration_samples, "number of EC reads used to measure the EC transaction latency (default=32, max=256)");
+
+/* ========================================================================== */
+
+/* values used when the calibration is disabled or fails */
+struct qc71_calibration_struct qc71_calibration = {
+	.sample_interval_ms = 1000,
+	.retry_delay_us     = 100,
+	.sensor_max_age_ms  = 250,
+};
+
+/* ========================================================================== */
+
+static int __init cmp_u64(const void *a, const void *b)
+{
+	u64 x = *(const u64 *) a, y = *(const u64 *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+static u64 __init percentile(const u64 *values, size_t count, unsigned int p)
+{
+	return values[(count - 1) * p / 100];
+}
+
+static void __init derive_settings(void)
+{
+	u64 sample_cost_ns = qc71_calibration.p90_ns * QC71_SAMPLE_EC_READS;
+
+	qc71_calibration.sample_interval_ms =
+		clamp_t(u64, div_u64(sample_cost_ns * SAMPLER_DUTY_CYCLE_INV, NSEC_PER_MSEC),
+			250, 10000);
+
+	/* a retry is likely to succeed after a typical transaction has finished */
+	qc71_calibration.retry_delay_us =
+		clamp_t(u64, div_u64(qc71_calibration.p50_ns, NSEC_PER_USEC), 20, 2000);
+
+	/* cached readings are not much older than what the sampler would provide */
+	qc71_calibration.sensor_max_age_ms =
+		clamp(qc71_calibration.sample_interval_ms / 4, 50U, 1000U);
+}
+
+int __init qc71_calibrate(void)
+{
+	size_t i, count = 0, n = clamp(calibration_samples, 1U, CALIBRATION_MAX_SAMPLES);
+	u64 *latencies, deadline;
+	int err = 0;
+
+	if (nocalibration)
+		return 0;
+
+	latencies = kmalloc_array(n, sizeof(*latencies), GFP_KERNEL);
+	if (!latencies)
+		return -ENOMEM;
+
+	deadline = ktime_get_ns() + CALIBRATION_TIME_LIMIT_NS;
+
+	for (i = 0; i < n && ktime_get_ns() < deadline; i++) {
+		union qc71_ec_result res;
+		u64 start = ktime_get_ns();
+
+		/* a single attempt, retries would distort the measurement */
+		if (qc71_ec_transaction(PROJ_ID_ADDR, 0, &res, true))
+			continue;
+
+		latencies[count++] = ktime_get_ns() - start;
+	}
+
+	if (count == 0) {
+		err = -EIO;
+		goto out;
+	}
+
+	sort(latencies, count, sizeof(*latencies), cmp_u64, NULL);
+
+	qc71_calibration.samples = count;
+	qc71_calibration.min_ns  = latencies[0];
+	qc71_calibration.p50_ns  = percentile(latencies, count, 50);
+	qc71_calibration.p90_ns  = percentile(latencies, count, 90);
+	qc71_calibration.p99_ns  = percentile(latencies, count, 99);
+	qc71_calibration.max_ns  = latencies[count - 1];
+
+	derive_settings();
+
+	pr_info("EC read latency (%u samples): median %llu us, p90 %llu us, max %llu us\n",
+		qc71_calibration.samples,
+		div_u64(qc71_calibration.p50_ns, NSEC_PER_USEC),
+		div_u64(qc71_calibration.p90_ns, NSEC_PER_USEC),
+		div_u64(qc71_calibration.max_ns, NSEC_PER_USEC));
+
+out:
+	kfree(latencies);
+	return err;
+}
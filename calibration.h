@@ -0,0 +1,31 @@
+// SPDX-License-Identifier: GPL-2.0
+#ifndef QC71_CALIBRATION_H
+#define QC71_CALIBRATION_H
+
+#include <linux/init.h>
+#include <linux/types.h>
+
+struct qc71_calibration_struct {
+	/* measured latency of a single EC read */
+	unsigned int samples;
+	u64 min_ns;
+	u64 p50_ns;
+	u64 p90_ns;
+	u64 p99_ns;
+	u64 max_ns;
+
+	/* derived defaults, used when the corresponding module parameter is 0 */
+	unsigned int sample_interval_ms;
+	unsigned int retry_delay_us;
+	unsigned int sensor_max_age_ms;
+};
+
+/* ========================================================================== */
+
+extern struct qc71_calibration_struct qc71_calibration;
+
+/* ========================================================================== */
+
+int __init qc71_calibrate(void);
+
+#endif /* QC71_CALIBRATION_H */
@@ -3,13 +3,17 @@
 
 #include <linux/debugfs.h>
 #include <linux/init.h>
+#include <linux/ktime.h>
 #include <linux/moduleparam.h>
 #include <linux/uaccess.h>
 #include <linux/sched/signal.h>
+#include <linux/seq_file.h>
 #include <linux/types.h>
 
+#include "calibration.h"
 #include "debugfs.h"
 #include "ec.h"
+#include "sensor.h"
 
 #if IS_ENABLED(CONFIG_DEBUG_FS)
 
@@ -98,8 +102,9 @@ static bool debugregs;
 module_param(debugregs, bool, 0444);
 MODULE_PARM_DESC(debugregs, "expose various EC registers in debugfs (default=false)");
 
-static struct dentry *qc71_debugfs_dir,
-		     *qc71_debugfs_regs_dir;
+struct dentry *qc71_debugfs_dir;
+
+static struct dentry *qc71_debugfs_regs_dir;
 
 /* ========================================================================== */
 
@@ -203,21 +208,119 @@ static const struct file_operations qc71_debugfs_ec_fops = {
 
 /* ========================================================================== */
 
+static int qc71_debugfs_ec_stats_show(struct seq_file *m, void *unused)
+{
+	struct qc71_ec_retry_stat retry_stats[QC71_EC_RETRY_STATS_SIZE];
+	struct qc71_ec_stats stats;
+	size_t i, count;
+
+	qc71_ec_get_stats(&stats);
+	count = qc71_ec_get_retry_stats(retry_stats, ARRAY_SIZE(retry_stats));
+
+	seq_printf(m, "transactions: %llu\n", stats.transactions);
+	seq_printf(m, "retried: %llu\n", stats.retried);
+	seq_printf(m, "retries: %llu\n", stats.retries);
+	seq_printf(m, "failed: %llu\n", stats.failed);
+	seq_printf(m, "retry_us: %llu\n", div_u64(stats.retry_ns, NSEC_PER_USEC));
+
+	for (i = 0; i < count; i++)
+		seq_printf(m, "addr %#06x: retries=%u failures=%u\n",
+			   (unsigned int) retry_stats[i].addr,
+			   retry_stats[i].retries, retry_stats[i].failures);
+
+	return 0;
+}
+
+static int qc71_debugfs_ec_stats_open(struct inode *inode, struct file *f)
+{
+	return single_open(f, qc71_debugfs_ec_stats_show, inode->i_private);
+}
+
+/* writing anything resets the counters */
+static ssize_t qc71_debugfs_ec_stats_write(struct file *f, const char __user *buf,
+					   size_t count, loff_t *offset)
+{
+	qc71_ec_reset_stats();
+
+	return count;
+}
+
+static const struct file_operations qc71_debugfs_ec_stats_fops = {
+	.owner = THIS_MODULE,
+	.open = qc71_debugfs_ec_stats_open,
+	.read = seq_read,
+	.write = qc71_debugfs_ec_stats_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+/* ========================================================================== */
+
+static int qc71_debugfs_calibration_show(struct seq_file *m, void *unused)
+{
+	const struct qc71_calibration_struct *c = &qc71_calibration;
+
+	seq_printf(m, "samples: %u\n", c->samples);
+	seq_printf(m, "min_ns: %llu\n", c->min_ns);
+	seq_printf(m, "p50_ns: %llu\n", c->p50_ns);
+	seq_printf(m, "p90_ns: %llu\n", c->p90_ns);
+	seq_printf(m, "p99_ns: %llu\n", c->p99_ns);
+	seq_printf(m, "max_ns: %llu\n", c->max_ns);
+	seq_printf(m, "sample_interval_ms: %u\n", c->sample_interval_ms);
+	seq_printf(m, "retry_delay_us: %u\n", c->retry_delay_us);
+	seq_printf(m, "sensor_max_age_ms: %u\n", c->sensor_max_age_ms);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(qc71_debugfs_calibration);
+
+/* ========================================================================== */
+
+static int qc71_debugfs_sensors_show(struct seq_file *m, void *unused)
+{
+	struct qc71_sensor_info info;
+	enum qc71_sensor_id id;
+
+	for (id = 0; id < QC71_SENSOR_COUNT; id++) {
+		if (qc71_sensor_get_info(id, &info))
+			continue;
+
+		seq_printf(m, "addr %#06x: ", (unsigned int) info.addr);
+
+		if (info.valid)
+			seq_printf(m, "value=%d age_ms=%llu", info.value,
+				   div_u64(info.age_ns, NSEC_PER_MSEC));
+		else
+			seq_puts(m, "value=- age_ms=-");
+
+		seq_printf(m, " hits=%llu refreshes=%llu\n", info.hits, info.refreshes);
+	}
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(qc71_debugfs_sensors);
+
+/* ========================================================================== */
+
 int __init qc71_debugfs_setup(void)
 {
 	struct dentry *d;
 	int err = 0;
 	size_t i;
 
-	if (!debugregs)
-		return -ENODEV;
-
 	qc71_debugfs_dir = debugfs_create_dir(DEBUGFS_DIR_NAME, NULL);
 	if (IS_ERR(qc71_debugfs_dir)) {
 		err = PTR_ERR(qc71_debugfs_dir);
 		goto out_error;
 	}
 
+	debugfs_create_file("ec_stats", 0600, qc71_debugfs_dir, NULL, &qc71_debugfs_ec_stats_fops);
+	debugfs_create_file("calibration", 0400, qc71_debugfs_dir, NULL, &qc71_debugfs_calibration_fops);
+	debugfs_create_file("sensors", 0400, qc71_debugfs_dir, NULL, &qc71_debugfs_sensors_fops);
+
+	if (!debugregs)
+		return 0;
+
 	qc71_debugfs_regs_dir = debugfs_create_dir("regs", qc71_debugfs_dir);
 	if (IS_ERR(qc71_debugfs_regs_dir)) {
 		err = PTR_ERR(qc71_debugfs_regs_dir);
@@ -241,6 +344,9 @@ int __init qc71_debugfs_setup(void)
 
 out_error_remove_dir:
 	debugfs_remove_recursive(qc71_debugfs_dir);
+	/* the other submodules check it before creating their entries */
+	qc71_debugfs_dir = NULL;
+	qc71_debugfs_regs_dir = NULL;
 out_error:
 	return err;
 }
@@ -4,8 +4,15 @@
 
 #if IS_ENABLED(CONFIG_DEBUG_FS)
 
+#include <linux/debugfs.h>
 #include <linux/init.h>
 
+/* ========================================================================== */
+
+extern struct dentry *qc71_debugfs_dir;
+
+/* ========================================================================== */
+
 int  __init qc71_debugfs_setup(void);
 void        qc71_debugfs_cleanup(void);
 
@@ -0,0 +1,490 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "pr.h"
+
+#include <linux/atomic.h>
+#include <linux/bitfield.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/lockdep.h>
+#include <linux/moduleparam.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/sysfs.h>
+#include <linux/types.h>
+#include <linux/workqueue.h>
+
+#include "determinism.h"
+#include "ec.h"
+#include "fan.h"
+#include "features.h"
+#include "pdev.h"
+#include "sampler.h"
+
+/* ========================================================================== */
+/*
+ * determinism mode pins the thermal envelope for benchmarking: the fans run
+ * at a fixed PWM value, the turbo level and the power limits are fixed, and
+ * the reduced fan duty cycle is disabled where it is supported. The previous state is saved when the
+ * mode is entered, and restored when it is left. If the firmware changes any
+ * of the pinned registers (detected from the periodic samples and from WMI
+ * events), the change is counted, reported, and reverted.
+ */
+
+/* the registers that are saved and pinned */
+struct qc71_determinism_regs {
+	uint8_t ctrl_1;      /* only CTRL_1_MANUAL_MODE */
+	uint8_t ctrl_2;      /* only CTRL_2_TURBO_LEVEL_MASK */
+	uint8_t bios_ctrl_3; /* only BIOS_CTRL_3_FAN_REDUCED_DUTY_CYCLE, 0 without 'fan_extras' */
+	uint8_t fan_ctrl;
+	uint8_t pwm[2];      /* raw */
+	uint8_t pl1, pl2, pl4;
+};
+
+/* ========================================================================== */
+
+static unsigned int determinism_pwm = 160;
+module_param(determinism_pwm, uint, 0644);
+MODULE_PARM_DESC(determinism_pwm, "fan PWM value in determinism mode, 0-255 (default=160)");
+
+static int determinism_turbo_level = -1;
+module_param(determinism_turbo_level, int, 0644);
+MODULE_PARM_DESC(determinism_turbo_level, "turbo level in determinism mode, 0-3, -1 keeps the current one (default=-1)");
+
+static unsigned int determinism_pl1;
+module_param(determinism_pl1, uint, 0644);
+MODULE_PARM_DESC(determinism_pl1, "PL1 value in determinism mode, 0 keeps the current one (default=0)");
+
+static unsigned int determinism_pl2;
+module_param(determinism_pl2, uint, 0644);
+MODULE_PARM_DESC(determinism_pl2, "PL2 value in determinism mode, 0 keeps the current one (default=0)");
+
+static unsigned int determinism_pl4;
+module_param(determinism_pl4, uint, 0644);
+MODULE_PARM_DESC(determinism_pl4, "PL4 value in determinism mode, 0 keeps the current one (default=0)");
+
+/* ========================================================================== */
+
+/* serializes entering and leaving the mode */
+static DEFINE_MUTEX(determinism_transition_lock);
+
+/* protects the state below against the drift check */
+static DEFINE_MUTEX(determinism_lock);
+static bool determinism_active;
+static struct qc71_determinism_regs determinism_saved;
+static int determinism_saved_fan_mode; /* see qc71_fan_get_mode() */
+
+/* the values read back after entering, used by the sampler callback as well */
+static DEFINE_SPINLOCK(determinism_expected_lock);
+static struct qc71_determinism_regs determinism_expected;
+
+static atomic_t determinism_drifts = ATOMIC_INIT(0);
+
+static void qc71_determinism_work_fn(struct work_struct *work);
+static DECLARE_WORK(determinism_work, qc71_determinism_work_fn);
+
+static bool determinism_initialized;
+
+/* ========================================================================== */
+
+static int qc71_determinism_read_byte(uint16_t addr, uint8_t mask, uint8_t *value)
+{
+	int err = ec_read_byte(addr);
+
+	if (err < 0)
+		return err;
+
+	*value = err & mask;
+
+	return 0;
+}
+
+static int qc71_determinism_read(struct qc71_determinism_regs *r)
+{
+	int err = 0;
+
+	err = err ?: qc71_determinism_read_byte(CTRL_1_ADDR, CTRL_1_MANUAL_MODE, &r->ctrl_1);
+	err = err ?: qc71_determinism_read_byte(CTRL_2_ADDR, CTRL_2_TURBO_LEVEL_MASK, &r->ctrl_2);
+
+	if (qc71_features.fan_extras)
+		err = err ?: qc71_determinism_read_byte(BIOS_CTRL_3_ADDR,
+							BIOS_CTRL_3_FAN_REDUCED_DUTY_CYCLE,
+							&r->bios_ctrl_3);
+	else
+		r->bios_ctrl_3 = 0;
+
+	err = err ?: qc71_determinism_read_byte(FAN_CTRL_ADDR, U8_MAX, &r->fan_ctrl);
+	err = err ?: qc71_determinism_read_byte(FAN_PWM_1_ADDR, U8_MAX, &r->pwm[0]);
+	err = err ?: qc71_determinism_read_byte(FAN_PWM_2_ADDR, U8_MAX, &r->pwm[1]);
+	err = err ?: qc71_determinism_read_byte(PL1_ADDR, U8_MAX, &r->pl1);
+	err = err ?: qc71_determinism_read_byte(PL2_ADDR, U8_MAX, &r->pl2);
+	err = err ?: qc71_determinism_read_byte(PL4_ADDR, U8_MAX, &r->pl4);
+
+	return err;
+}
+
+static int qc71_determinism_update_bits(uint16_t addr, uint8_t mask, uint8_t value)
+{
+	int status = ec_read_byte(addr);
+
+	if (status < 0)
+		return status;
+
+	if ((status & mask) == (value & mask))
+		return 0;
+
+	return ec_write_byte(addr, (status & ~mask) | (value & mask));
+}
+
+/* writes the registers that differ from 'target', returns the number of changed registers */
+static int qc71_determinism_apply(const struct qc71_determinism_regs *target,
+				  const struct qc71_determinism_regs *current_regs)
+{
+	int err = 0, changed = 0;
+
+#define APPLY(field, write) \
+	do { \
+		if (!err && target->field != current_regs->field) { \
+			err = (write); \
+			changed += 1; \
+		} \
+	} while (0)
+
+	/* the same order as in qc71_fan_set_mode() */
+	APPLY(ctrl_1,      qc71_determinism_update_bits(CTRL_1_ADDR, CTRL_1_MANUAL_MODE, target->ctrl_1));
+	APPLY(fan_ctrl,    qc71_fan_set_ctrl(target->fan_ctrl));
+	APPLY(pwm[0],      ec_write_byte(FAN_PWM_1_ADDR, target->pwm[0]));
+	APPLY(pwm[1],      ec_write_byte(FAN_PWM_2_ADDR, target->pwm[1]));
+	APPLY(ctrl_2,      qc71_determinism_update_bits(CTRL_2_ADDR, CTRL_2_TURBO_LEVEL_MASK, target->ctrl_2));
+	if (qc71_features.fan_extras)
+		APPLY(bios_ctrl_3, qc71_determinism_update_bits(BIOS_CTRL_3_ADDR,
+								BIOS_CTRL_3_FAN_REDUCED_DUTY_CYCLE,
+								target->bios_ctrl_3));
+	APPLY(pl1,         ec_write_byte(PL1_ADDR, target->pl1));
+	APPLY(pl2,         ec_write_byte(PL2_ADDR, target->pl2));
+	APPLY(pl4,         ec_write_byte(PL4_ADDR, target->pl4));
+
+#undef APPLY
+
+	return err ?: changed;
+}
+
+/* ========================================================================== */
+
+static void qc71_determinism_sample(struct qc71_sampler_consumer *consumer,
+				    const struct qc71_sample *s)
+{
+	const struct qc71_determinism_regs *e = &determinism_expected;
+	unsigned long flags;
+	bool drift;
+
+	spin_lock_irqsave(&determinism_expected_lock, flags);
+
+	drift = (s->ctrl_1 & CTRL_1_MANUAL_MODE) != e->ctrl_1 ||
+		(s->ctrl_2 & CTRL_2_TURBO_LEVEL_MASK) != e->ctrl_2 ||
+		(qc71_features.fan_extras &&
+		 (s->bios_ctrl_3 & BIOS_CTRL_3_FAN_REDUCED_DUTY_CYCLE) != e->bios_ctrl_3) ||
+		s->fan_ctrl != e->fan_ctrl ||
+		s->pwm[0] != e->pwm[0] || s->pwm[1] != e->pwm[1] ||
+		s->pl1 != e->pl1 || s->pl2 != e->pl2 || s->pl4 != e->pl4;
+
+	spin_unlock_irqrestore(&determinism_expected_lock, flags);
+
+	/* the work re-reads the registers, the sample might predate entering the mode */
+	if (drift)
+		schedule_work(&determinism_work);
+}
+
+static struct qc71_sampler_consumer determinism_consumer = {
+	.sample = qc71_determinism_sample,
+};
+
+static void qc71_determinism_work_fn(struct work_struct *work)
+{
+	struct qc71_determinism_regs current_regs, expected;
+	unsigned long flags;
+	int err;
+
+	mutex_lock(&determinism_lock);
+
+	if (!determinism_active)
+		goto out;
+
+	err = qc71_determinism_read(&current_regs);
+	if (err) {
+		pr_warn("cannot read registers: %d\n", err);
+		goto out;
+	}
+
+	spin_lock_irqsave(&determinism_expected_lock, flags);
+	expected = determinism_expected;
+	spin_unlock_irqrestore(&determinism_expected_lock, flags);
+
+	err = qc71_determinism_apply(&expected, &current_regs);
+	if (err < 0) {
+		pr_warn("cannot revert firmware changes: %d\n", err);
+	} else if (err > 0) {
+		pr_info("reverted %d register(s) changed by the firmware\n", err);
+		atomic_inc(&determinism_drifts);
+		sysfs_notify(&qc71_platform_dev->dev.kobj, NULL, "determinism_drift");
+	}
+
+out:
+	mutex_unlock(&determinism_lock);
+}
+
+/* ========================================================================== */
+
+/* 'determinism_lock' must be held */
+static int qc71_determinism_restore(void)
+{
+	struct qc71_determinism_regs current_regs, target;
+	bool manual_fan = determinism_saved_fan_mode == 1;
+	int err;
+
+	lockdep_assert_held(&determinism_lock);
+
+	err = qc71_determinism_read(&current_regs);
+	if (err)
+		return err;
+
+	target = determinism_saved;
+
+	/* the saved fan registers are only meaningful if they were controlled manually */
+	if (!manual_fan) {
+		target.fan_ctrl = current_regs.fan_ctrl;
+		target.pwm[0] = current_regs.pwm[0];
+		target.pwm[1] = current_regs.pwm[1];
+	}
+
+	err = qc71_determinism_apply(&target, &current_regs);
+	if (err < 0)
+		return err;
+
+	if (!manual_fan)
+		return qc71_fan_set_mode(determinism_saved_fan_mode, QC71_FAN_MODE_SOURCE_DETERMINISM);
+
+	return 0;
+}
+
+/* 'determinism_lock' must be held */
+static int qc71_determinism_enter(void)
+{
+	struct qc71_determinism_regs pinned;
+	unsigned int pwm = min(READ_ONCE(determinism_pwm), (unsigned int) U8_MAX);
+	int turbo_level = READ_ONCE(determinism_turbo_level);
+	unsigned long flags;
+	int err, i;
+
+	lockdep_assert_held(&determinism_lock);
+
+	err = qc71_fan_get_mode();
+	if (err < 0)
+		return err;
+
+	determinism_saved_fan_mode = err;
+
+	err = qc71_determinism_read(&determinism_saved);
+	if (err)
+		return err;
+
+	pinned = determinism_saved;
+	pinned.ctrl_1 = CTRL_1_MANUAL_MODE;
+	if (qc71_features.fan_extras)
+		pinned.bios_ctrl_3 = 0;
+
+	if (turbo_level >= 0)
+		pinned.ctrl_2 = FIELD_PREP(CTRL_2_TURBO_LEVEL_MASK, min(turbo_level, 3));
+
+	if (READ_ONCE(determinism_pl1))
+		pinned.pl1 = min(READ_ONCE(determinism_pl1), (unsigned int) U8_MAX);
+	if (READ_ONCE(determinism_pl2))
+		pinned.pl2 = min(READ_ONCE(determinism_pl2), (unsigned int) U8_MAX);
+	if (READ_ONCE(determinism_pl4))
+		pinned.pl4 = min(READ_ONCE(determinism_pl4), (unsigned int) U8_MAX);
+
+	/* the fans are handled by fan.c below */
+	pinned.fan_ctrl = determinism_saved.fan_ctrl;
+	pinned.pwm[0] = determinism_saved.pwm[0];
+	pinned.pwm[1] = determinism_saved.pwm[1];
+
+	err = qc71_determinism_apply(&pinned, &determinism_saved);
+	if (err < 0)
+		goto out_restore;
+
+	err = qc71_fan_set_mode(1, QC71_FAN_MODE_SOURCE_DETERMINISM);
+
+	for (i = 0; i < ARRAY_SIZE(pinned.pwm) && !err; i++)
+		err = qc71_fan_set_pwm(i, pwm);
+
+	if (err)
+		goto out_restore;
+
+	/* whatever the EC reports now is what is kept */
+	err = qc71_determinism_read(&pinned);
+	if (err)
+		goto out_restore;
+
+	spin_lock_irqsave(&determinism_expected_lock, flags);
+	determinism_expected = pinned;
+	spin_unlock_irqrestore(&determinism_expected_lock, flags);
+
+	determinism_active = true;
+
+	pr_info("entered determinism mode\n");
+
+	return 0;
+
+out_restore:
+	pr_warn("cannot enter determinism mode: %d\n", err);
+
+	(void) qc71_determinism_restore();
+
+	return err;
+}
+
+/* 'determinism_lock' must be held */
+static int qc71_determinism_leave(void)
+{
+	int err;
+
+	lockdep_assert_held(&determinism_lock);
+
+	err = qc71_determinism_restore();
+	if (err < 0) {
+		pr_warn("cannot restore state: %d\n", err);
+		return err;
+	}
+
+	pr_info("left determinism mode\n");
+
+	return 0;
+}
+
+/* ========================================================================== */
+
+int qc71_determinism_get(void)
+{
+	return READ_ONCE(determinism_active);
+}
+
+unsigned int qc71_determinism_drift_count(void)
+{
+	return atomic_read(&determinism_drifts);
+}
+
+/* 'determinism_transition_lock' must be held */
+static int qc71_determinism_set_locked(bool on)
+{
+	int err = 0;
+
+	lockdep_assert_held(&determinism_transition_lock);
+
+	mutex_lock(&determinism_lock);
+
+	if (on == determinism_active) {
+		mutex_unlock(&determinism_lock);
+		return 0;
+	}
+
+	if (on) {
+		err = qc71_determinism_enter();
+		mutex_unlock(&determinism_lock);
+
+		if (!err) {
+			atomic_set(&determinism_drifts, 0);
+			qc71_sampler_register(&determinism_consumer);
+		}
+	} else {
+		determinism_active = false;
+		mutex_unlock(&determinism_lock);
+
+		qc71_sampler_unregister(&determinism_consumer);
+		cancel_work_sync(&determinism_work);
+
+		mutex_lock(&determinism_lock);
+		err = qc71_determinism_leave();
+		mutex_unlock(&determinism_lock);
+	}
+
+	return err;
+}
+
+int qc71_determinism_set(bool on)
+{
+	int err;
+
+	if (!determinism_initialized)
+		return -ENODEV;
+
+	err = mutex_lock_interruptible(&determinism_transition_lock);
+	if (err)
+		return err;
+
+	err = qc71_determinism_set_locked(on);
+
+	mutex_unlock(&determinism_transition_lock);
+	return err;
+}
+
+void qc71_determinism_check(void)
+{
+	/*
+	 * under the lock, leaving the mode clears the flag with it held before
+	 * cancelling the work, so the work cannot be queued after that
+	 */
+	mutex_lock(&determinism_lock);
+
+	if (determinism_active)
+		schedule_work(&determinism_work);
+
+	mutex_unlock(&determinism_lock);
+}
+
+int qc71_determinism_write_begin(void)
+{
+	int err = mutex_lock_interruptible(&determinism_transition_lock);
+
+	if (err)
+		return err;
+
+	/* only changes with 'determinism_transition_lock' held */
+	if (determinism_active) {
+		mutex_unlock(&determinism_transition_lock);
+		return -EBUSY;
+	}
+
+	return 0;
+}
+
+void qc71_determinism_write_end(void)
+{
+	mutex_unlock(&determinism_transition_lock);
+}
+
+/* ========================================================================== */
+
+int __init qc71_determinism_setup(void)
+{
+	if (!qc71_features.fan_boost)
+		return -ENODEV;
+
+	determinism_initialized = true;
+
+	return 0;
+}
+
+void qc71_determinism_cleanup(void)
+{
+	int err;
+
+	/* not interruptible, the module must not be unloaded with the state pinned */
+	mutex_lock(&determinism_transition_lock);
+
+	err = qc71_determinism_set_locked(false);
+	determinism_initialized = false;
+
+	mutex_unlock(&determinism_transition_lock);
+
+	if (err)
+		pr_warn("the state before entering determinism mode might not have been restored\n");
+}
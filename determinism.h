@@ -0,0 +1,73 @@
+// SPDX-License-Identifier: GPL-2.0
+#ifndef QC71_DETERMINISM_H
+#define QC71_DETERMINISM_H
+
+#include <linux/types.h>
+
+#if IS_ENABLED(CONFIG_HWMON)
+
+#include <linux/init.h>
+
+int  qc71_determinism_get(void);
+int  qc71_determinism_set(bool on);
+unsigned int qc71_determinism_drift_count(void);
+
+/* called when an event suggests that the firmware changed something */
+void qc71_determinism_check(void);
+
+/*
+ * user requested writes to the fan and power registers must be enclosed in
+ * these, they fail with -EBUSY while the mode is active, so that such writes
+ * are neither reverted nor counted as firmware drift
+ */
+int  qc71_determinism_write_begin(void);
+void qc71_determinism_write_end(void);
+
+int  __init qc71_determinism_setup(void);
+void        qc71_determinism_cleanup(void);
+
+#else
+
+static inline int qc71_determinism_get(void)
+{
+	return -EOPNOTSUPP;
+}
+
+static inline int qc71_determinism_set(bool on)
+{
+	return -EOPNOTSUPP;
+}
+
+static inline unsigned int qc71_determinism_drift_count(void)
+{
+	return 0;
+}
+
+static inline void qc71_determinism_check(void)
+{
+
+}
+
+static inline int qc71_determinism_write_begin(void)
+{
+	return 0;
+}
+
+static inline void qc71_determinism_write_end(void)
+{
+
+}
+
+static inline int qc71_determinism_setup(void)
+{
+	return 0;
+}
+
+static inline void qc71_determinism_cleanup(void)
+{
+
+}
+
+#endif
+
+#endif /* QC71_DETERMINISM_H */
@@ -2,23 +2,68 @@
 #include "pr.h"
 
 #include <linux/acpi.h>
+#include <linux/atomic.h>
 #include <linux/compiler_types.h>
+#include <linux/delay.h>
 #include <linux/error-injection.h>
+#include <linux/ktime.h>
+#include <linux/moduleparam.h>
 #include <linux/rwsem.h>
 #include <linux/printk.h>
+#include <linux/sched/signal.h>
+#include <linux/spinlock.h>
 #include <linux/wmi.h>
 
+#include "calibration.h"
 #include "ec.h"
+#include "sensor.h"
 #include "wmi.h"
 
 /* ========================================================================== */
 
+#define EC_RETRY_READ_EIO     BIT(0)
+#define EC_RETRY_WRITE_EIO    BIT(1)
+#define EC_RETRY_READ_ENODATA BIT(2)
+
+/* ========================================================================== */
+
+static unsigned int ec_max_attempts = 3;
+module_param(ec_max_attempts, uint, 0644);
+MODULE_PARM_DESC(ec_max_attempts, "maximum number of attempts of a failing EC transaction (default=3)");
+
+static unsigned int ec_retry_delay_us;
+module_param(ec_retry_delay_us, uint, 0644);
+MODULE_PARM_DESC(ec_retry_delay_us, "delay before the first retry of an EC transaction in microseconds, doubled after each retry, 0 derives it from the measured EC latency (default=0)");
+
+static unsigned int ec_retry_max_delay_us = 5000;
+module_param(ec_retry_max_delay_us, uint, 0644);
+MODULE_PARM_DESC(ec_retry_max_delay_us, "upper bound of the delay between EC transaction retries in microseconds (default=5000)");
+
+static unsigned int ec_retry_on = EC_RETRY_READ_EIO | EC_RETRY_WRITE_EIO | EC_RETRY_READ_ENODATA;
+module_param(ec_retry_on, uint, 0644);
+MODULE_PARM_DESC(ec_retry_on, "bitmask of retryable errors: 1 - failed read, 2 - failed write, 4 - malformed read result (default=7)");
+
+/* ========================================================================== */
+
 static DECLARE_RWSEM(ec_lock);
 
+static struct {
+	atomic64_t transactions;
+	atomic64_t retried;
+	atomic64_t retries;
+	atomic64_t failed;
+	atomic64_t retry_ns;
+} ec_stats;
+
+/* only the first QC71_EC_RETRY_STATS_SIZE distinct addresses are tracked */
+static DEFINE_SPINLOCK(ec_retry_stats_lock);
+static struct qc71_ec_retry_stat ec_retry_stats[QC71_EC_RETRY_STATS_SIZE];
+static size_t ec_retry_stats_count;
+
 /* ========================================================================== */
 
-int __must_check qc71_ec_transaction(uint16_t addr, uint16_t data,
-				     union qc71_ec_result *result, bool read)
+noinline int __must_check qc71_ec_transaction(uint16_t addr, uint16_t data,
+					      union qc71_ec_result *result, bool read)
 {
 	uint8_t buf[] = {
 		addr & 0xFF,
@@ -87,3 +132,142 @@ out:
 	return err;
 }
 ALLOW_ERROR_INJECTION(qc71_ec_transaction, ERRNO);
+
+/* ========================================================================== */
+
+static bool qc71_ec_error_is_retryable(int err, bool read)
+{
+	unsigned int mask = READ_ONCE(ec_retry_on);
+
+	switch (err) {
+	case -EIO:
+		return mask & (read ? EC_RETRY_READ_EIO : EC_RETRY_WRITE_EIO);
+	case -ENODATA:
+		return read && (mask & EC_RETRY_READ_ENODATA);
+	}
+
+	return false;
+}
+
+static void qc71_ec_account_retries(uint16_t addr, unsigned int retries, bool failed)
+{
+	unsigned long flags;
+	size_t i;
+
+	spin_lock_irqsave(&ec_retry_stats_lock, flags);
+
+	for (i = 0; i < ec_retry_stats_count; i++)
+		if (ec_retry_stats[i].addr == addr)
+			break;
+
+	if (i == ec_retry_stats_count && i < ARRAY_SIZE(ec_retry_stats)) {
+		ec_retry_stats[i].addr = addr;
+		ec_retry_stats_count += 1;
+	}
+
+	if (i < ec_retry_stats_count) {
+		ec_retry_stats[i].retries  += retries;
+		ec_retry_stats[i].failures += failed;
+	}
+
+	spin_unlock_irqrestore(&ec_retry_stats_lock, flags);
+}
+
+int __must_check qc71_ec_transaction_retry(uint16_t addr, uint16_t data,
+					   union qc71_ec_result *result, bool read)
+{
+	unsigned int attempt = 1, delay_us = READ_ONCE(ec_retry_delay_us) ?: qc71_calibration.retry_delay_us;
+	ktime_t start;
+	int err;
+
+	atomic64_inc(&ec_stats.transactions);
+
+	err = qc71_ec_transaction(addr, data, result, read);
+	if (likely(!err)) {
+		if (!read)
+			qc71_sensor_invalidate_addr(addr);
+
+		return 0;
+	}
+
+	start = ktime_get();
+
+	/* the bound also applies to the first delay */
+	delay_us = min(delay_us, READ_ONCE(ec_retry_max_delay_us));
+
+	while (err && qc71_ec_error_is_retryable(err, read) &&
+	       attempt < READ_ONCE(ec_max_attempts) && !fatal_signal_pending(current)) {
+		usleep_range(delay_us, delay_us + delay_us / 4);
+
+		delay_us = min(2 * delay_us, READ_ONCE(ec_retry_max_delay_us));
+		attempt += 1;
+
+		err = qc71_ec_transaction(addr, data, result, read);
+	}
+
+	/*
+	 * only after the last attempt, otherwise a read between two attempts
+	 * could cache the value from before the write, and even a failed
+	 * write might have reached the EC
+	 */
+	if (!read)
+		qc71_sensor_invalidate_addr(addr);
+
+	if (attempt > 1) {
+		atomic64_inc(&ec_stats.retried);
+		atomic64_add(attempt - 1, &ec_stats.retries);
+		atomic64_add(ktime_to_ns(ktime_sub(ktime_get(), start)), &ec_stats.retry_ns);
+	}
+
+	if (err)
+		atomic64_inc(&ec_stats.failed);
+
+	qc71_ec_account_retries(addr, attempt - 1, !!err);
+
+	if (err)
+		pr_debug("EC transaction at %#06x failed after %u attempt(s): %d\n",
+			 (unsigned int) addr, attempt, err);
+
+	return err;
+}
+
+/* ========================================================================== */
+
+void qc71_ec_get_stats(struct qc71_ec_stats *stats)
+{
+	stats->transactions = atomic64_read(&ec_stats.transactions);
+	stats->retried      = atomic64_read(&ec_stats.retried);
+	stats->retries      = atomic64_read(&ec_stats.retries);
+	stats->failed       = atomic64_read(&ec_stats.failed);
+	stats->retry_ns     = atomic64_read(&ec_stats.retry_ns);
+}
+
+size_t qc71_ec_get_retry_stats(struct qc71_ec_retry_stat *stats, size_t count)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&ec_retry_stats_lock, flags);
+
+	count = min(count, ec_retry_stats_count);
+	memcpy(stats, ec_retry_stats, count * sizeof(*stats));
+
+	spin_unlock_irqrestore(&ec_retry_stats_lock, flags);
+
+	return count;
+}
+
+void qc71_ec_reset_stats(void)
+{
+	unsigned long flags;
+
+	atomic64_set(&ec_stats.transactions, 0);
+	atomic64_set(&ec_stats.retried, 0);
+	atomic64_set(&ec_stats.retries, 0);
+	atomic64_set(&ec_stats.failed, 0);
+	atomic64_set(&ec_stats.retry_ns, 0);
+
+	spin_lock_irqsave(&ec_retry_stats_lock, flags);
+	ec_retry_stats_count = 0;
+	memset(ec_retry_stats, 0, sizeof(ec_retry_stats));
+	spin_unlock_irqrestore(&ec_retry_stats_lock, flags);
+}
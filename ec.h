@@ -236,17 +236,42 @@ union qc71_ec_result {
 	} bytes;
 };
 
+#define QC71_EC_RETRY_STATS_SIZE 32
+
+struct qc71_ec_retry_stat {
+	uint16_t addr;
+	unsigned int retries;
+	unsigned int failures; /* transactions that failed even after retrying */
+};
+
+struct qc71_ec_stats {
+	u64 transactions;
+	u64 retried;  /* transactions that needed at least one retry */
+	u64 retries;
+	u64 failed;
+	u64 retry_ns; /* time spent retrying, including the backoff delays */
+};
+
+/* a single attempt, this is the error injection point */
 int __must_check qc71_ec_transaction(uint16_t addr, uint16_t data,
 				     union qc71_ec_result *result, bool read);
 
+/* retries transient failures according to the 'ec_retry_*' module parameters */
+int __must_check qc71_ec_transaction_retry(uint16_t addr, uint16_t data,
+					   union qc71_ec_result *result, bool read);
+
+void   qc71_ec_get_stats(struct qc71_ec_stats *stats);
+size_t qc71_ec_get_retry_stats(struct qc71_ec_retry_stat *stats, size_t count);
+void   qc71_ec_reset_stats(void);
+
 static inline __must_check int qc71_ec_read(uint16_t addr, union qc71_ec_result *result)
 {
-	return qc71_ec_transaction(addr, 0, result, true);
+	return qc71_ec_transaction_retry(addr, 0, result, true);
 }
 
 static inline __must_check int qc71_ec_write(uint16_t addr, uint16_t data)
 {
-	return qc71_ec_transaction(addr, data, NULL, false);
+	return qc71_ec_transaction_retry(addr, data, NULL, false);
 }
 
 static inline __must_check int ec_write_byte(uint16_t addr, uint8_t data)
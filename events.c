@@ -7,12 +7,17 @@
 #include <linux/init.h>
 #include <linux/input.h>
 #include <linux/input/sparse-keymap.h>
+#include <linux/ktime.h>
 #include <linux/leds.h>
+#include <linux/moduleparam.h>
 #include <linux/version.h>
 
+#include "determinism.h"
 #include "events.h"
 #include "misc.h"
 #include "pdev.h"
+#include "telemetry.h"
+#include "tracing.h"
 #include "wmi.h"
 
 /* ========================================================================== */
@@ -64,13 +69,20 @@ static const struct key_entry qc71_wmi_hotkeys[] = {
 
 /* ========================================================================== */
 
+static bool kbd_bl_passthrough;
+module_param(kbd_bl_passthrough, bool, 0644);
+MODULE_PARM_DESC(kbd_bl_passthrough, "report the keyboard backlight hotkeys to userspace instead of handling them (default=false)");
+
+/* ========================================================================== */
+
 static struct input_dev *qc71_input_dev;
 
 /* ========================================================================== */
 
 static void toggle_fn_lock_from_event_handler(void)
 {
-	int status = qc71_fn_lock_get_state();
+	/* the EC has just toggled it, so a cached value would be wrong */
+	int status = qc71_fn_lock_get_state(0);
 
 	if (status < 0)
 		return;
@@ -84,13 +96,11 @@ static void toggle_fn_lock_from_event_handler(void)
 extern struct rw_semaphore leds_list_lock;
 extern struct list_head leds_list;
 
-static void emit_keyboard_led_hw_changed(void)
+/* 'leds_list_lock' must be held */
+static struct led_classdev *find_keyboard_led(void)
 {
 	struct led_classdev *led;
 
-	if (down_read_killable(&leds_list_lock))
-		return;
-
 	list_for_each_entry (led, &leds_list, node) {
 		size_t name_length;
 		const char *suffix;
@@ -105,25 +115,92 @@ static void emit_keyboard_led_hw_changed(void)
 
 		suffix = led->name + name_length - strlen(KBD_BL_LED_SUFFIX);
 
-		if (strcmp(suffix, KBD_BL_LED_SUFFIX) == 0) {
-			if (mutex_lock_interruptible(&led->led_access))
-				break;
+		if (strcmp(suffix, KBD_BL_LED_SUFFIX) == 0)
+			return led;
+	}
 
-			if (led_update_brightness(led) >= 0)
-				led_classdev_notify_brightness_hw_changed(led, led->brightness);
+	return NULL;
+}
 
-			mutex_unlock(&led->led_access);
-			break;
-		}
+/*
+ * returns the maximum brightness of the keyboard backlight LED that can be
+ * notified of changes, or a negative errno if there is none
+ */
+static int keyboard_led_max_brightness(void)
+{
+	struct led_classdev *led;
+	int max_brightness = -ENODEV;
+
+	if (down_read_killable(&leds_list_lock))
+		return -EINTR;
+
+	led = find_keyboard_led();
+	if (led)
+		max_brightness = led->max_brightness;
+
+	up_read(&leds_list_lock);
+
+	return max_brightness;
+}
+
+static void emit_keyboard_led_hw_changed(void)
+{
+	struct led_classdev *led;
+
+	if (down_read_killable(&leds_list_lock))
+		return;
+
+	led = find_keyboard_led();
+
+	if (led && !mutex_lock_interruptible(&led->led_access)) {
+		if (led_update_brightness(led) >= 0)
+			led_classdev_notify_brightness_hw_changed(led, led->brightness);
+
+		mutex_unlock(&led->led_access);
 	}
 
 	up_read(&leds_list_lock);
 }
 #else
+static inline int keyboard_led_max_brightness(void)
+{
+	return -ENODEV;
+}
+
 static inline void emit_keyboard_led_hw_changed(void)
 { }
 #endif
 
+/*
+ * returns true if the hotkey has been handled, if userspace could not be
+ * notified of the change, the hotkey is left to userspace instead
+ */
+static bool step_keyboard_backlight_from_event_handler(int delta)
+{
+	int level, max_level;
+
+	if (kbd_bl_passthrough)
+		return false;
+
+	/* decided before the change, so that userspace never changes it a second time */
+	max_level = keyboard_led_max_brightness();
+	if (max_level <= 0) {
+		pr_debug("no keyboard backlight LED to notify, reporting the hotkey\n");
+		return false;
+	}
+
+	level = qc71_kbd_backlight_step(delta, max_level);
+	if (level < 0) {
+		pr_debug("cannot change keyboard backlight: %d\n", level);
+		return false;
+	}
+
+	pr_info("keyboard backlight level: %d\n", level);
+	emit_keyboard_led_hw_changed();
+
+	return true;
+}
+
 static void process_event_72(const union acpi_object *obj)
 {
 	bool do_report = true;
@@ -232,29 +309,34 @@ static void process_event_72(const union acpi_object *obj)
 	/* fan boost state changed */
 	case 167:
 		pr_info("fan boost state changed\n");
+		qc71_determinism_check();
 		break;
 
 	/* charger unplugged/plugged in */
 	case 171:
 		pr_info("AC plugged/unplugged\n");
+		qc71_kbd_backlight_invalidate();
+		qc71_determinism_check();
 		break;
 
 	/* perf mode button pressed */
 	case 176:
 		pr_info("change perf mode\n");
 		/* TODO: should it be handled here? */
+		qc71_kbd_backlight_invalidate();
+		qc71_determinism_check();
 		break;
 
-	/* increase keyboard backlight */
+	/* decrease keyboard backlight */
 	case 177:
 		pr_info("keyboard backlight decrease\n");
-		/* TODO: should it be handled here? */
+		do_report = !step_keyboard_backlight_from_event_handler(-1);
 		break;
 
-	/* decrease keyboard backlight */
+	/* increase keyboard backlight */
 	case 178:
 		pr_info("keyboard backlight increase\n");
-		/* TODO: should it be handled here? */
+		do_report = !step_keyboard_backlight_from_event_handler(+1);
 		break;
 
 	/* toggle Fn lock (Fn+ESC)*/
@@ -267,6 +349,7 @@ static void process_event_72(const union acpi_object *obj)
 	/* keyboard backlight brightness changed */
 	case 240:
 		pr_info("keyboard backlight changed\n");
+		qc71_kbd_backlight_invalidate();
 		emit_keyboard_led_hw_changed();
 		break;
 
@@ -281,13 +364,30 @@ static void process_event_72(const union acpi_object *obj)
 
 }
 
+static unsigned int qc71_wmi_event_guid_index(const char *guid)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(qc71_wmi_event_guids); i++)
+		if (qc71_wmi_event_guids[i].guid == guid)
+			break;
+
+	return i;
+}
+
 static void process_event(const union acpi_object *obj, const char *guid)
 {
+	u64 start = ktime_get_ns();
+
 	pr_info("guid=%s obj=%p\n", guid, obj);
 
 	if (!obj)
 		return;
 
+	if (obj->type == ACPI_TYPE_INTEGER)
+		qc71_telemetry_log_event(qc71_wmi_event_guid_index(guid),
+					 (u32) obj->integer.value);
+
 	pr_info("obj->type = %d\n", (int) obj->type);
 	if (obj->type == ACPI_TYPE_INTEGER) {
 		pr_info("int = %u\n", (unsigned int) obj->integer.value);
@@ -300,6 +400,10 @@ static void process_event(const union acpi_object *obj, const char *guid)
 
 	if (strcmp(guid, QC71_WMI_EVENT_72_GUID) == 0)
 		process_event_72(obj);
+
+	trace_qc71_wmi_event(guid,
+			     obj->type == ACPI_TYPE_INTEGER ? (u32) obj->integer.value : U32_MAX,
+			     ktime_get_ns() - start);
 }
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 12, 0)
@@ -18,19 +18,27 @@ static inline int fixp_linear_interpolate(int x0, int y0, int x1, int y1, int x)
 #include <linux/fixp-arith.h>
 #endif
 
+#include <linux/atomic.h>
 #include <linux/lockdep.h>
 #include <linux/mutex.h>
 #include <linux/types.h>
 
 #include "ec.h"
 #include "fan.h"
+#include "sensor.h"
+#include "tracing.h"
 #include "util.h"
 
 /* ========================================================================== */
 
-static const uint16_t qc71_fan_rpm_addrs[] = {
-	FAN_RPM_1_ADDR,
-	FAN_RPM_2_ADDR,
+static const enum qc71_sensor_id qc71_fan_rpm_sensors[] = {
+	QC71_SENSOR_FAN1_RPM,
+	QC71_SENSOR_FAN2_RPM,
+};
+
+static const enum qc71_sensor_id qc71_fan_pwm_sensors[] = {
+	QC71_SENSOR_FAN1_PWM,
+	QC71_SENSOR_FAN2_PWM,
 };
 
 static const uint16_t qc71_fan_pwm_addrs[] = {
@@ -38,17 +46,35 @@ static const uint16_t qc71_fan_pwm_addrs[] = {
 	FAN_PWM_2_ADDR,
 };
 
-static const uint16_t qc71_fan_temp_addrs[] = {
-	FAN_TEMP_1_ADDR,
-	FAN_TEMP_2_ADDR,
+static const enum qc71_sensor_id qc71_fan_temp_sensors[] = {
+	QC71_SENSOR_FAN1_TEMP,
+	QC71_SENSOR_FAN2_TEMP,
 };
 
 /* ========================================================================== */
 
 static DEFINE_MUTEX(fan_lock);
 
+static atomic_t fan_ctrl_writes = ATOMIC_INIT(0);
+
 /* ========================================================================== */
 
+/*
+ * the counter is incremented both before and after the write, so a sample
+ * that reads it after FAN_CTRL_ADDR will always see it change if the
+ * write overlapped with the sampling
+ */
+static int qc71_fan_write_ctrl(uint8_t value)
+{
+	int err;
+
+	atomic_inc(&fan_ctrl_writes);
+	err = ec_write_byte(FAN_CTRL_ADDR, value);
+	atomic_inc(&fan_ctrl_writes);
+
+	return err;
+}
+
 static int qc71_fan_get_status(void)
 {
 	return ec_read_byte(FAN_CTRL_ADDR);
@@ -71,7 +97,7 @@ static int qc71_fan_get_mode_unlocked(void)
 			return err;
 
 		if (err & FAN_CTRL_FAN_BOOST) {
-			err = qc71_fan_get_pwm(0);
+			err = qc71_fan_get_pwm(0, 0);
 
 			if (err < 0)
 				return err;
@@ -95,20 +121,12 @@ static int qc71_fan_get_mode_unlocked(void)
 
 /* ========================================================================== */
 
-int qc71_fan_get_rpm(uint8_t fan_index)
+int qc71_fan_get_rpm(uint8_t fan_index, unsigned int max_age_ms)
 {
-	union qc71_ec_result res;
-	int err;
-
-	if (fan_index >= ARRAY_SIZE(qc71_fan_rpm_addrs))
+	if (fan_index >= ARRAY_SIZE(qc71_fan_rpm_sensors))
 		return -EINVAL;
 
-	err = qc71_ec_read(qc71_fan_rpm_addrs[fan_index], &res);
-
-	if (err)
-		return err;
-
-	return res.bytes.b1 << 8 | res.bytes.b2;
+	return qc71_sensor_read(qc71_fan_rpm_sensors[fan_index], max_age_ms);
 }
 
 int qc71_fan_query_abnorm(void)
@@ -121,14 +139,14 @@ int qc71_fan_query_abnorm(void)
 	return !!(res & CTRL_1_FAN_ABNORMAL);
 }
 
-int qc71_fan_get_pwm(uint8_t fan_index)
+int qc71_fan_get_pwm(uint8_t fan_index, unsigned int max_age_ms)
 {
 	int err;
 
-	if (fan_index >= ARRAY_SIZE(qc71_fan_pwm_addrs))
+	if (fan_index >= ARRAY_SIZE(qc71_fan_pwm_sensors))
 		return -EINVAL;
 
-	err = ec_read_byte(qc71_fan_pwm_addrs[fan_index]);
+	err = qc71_sensor_read(qc71_fan_pwm_sensors[fan_index], max_age_ms);
 	if (err < 0)
 		return err;
 
@@ -137,21 +155,31 @@ int qc71_fan_get_pwm(uint8_t fan_index)
 
 int qc71_fan_set_pwm(uint8_t fan_index, uint8_t pwm)
 {
+	uint8_t raw;
+	int err;
+
 	if (fan_index >= ARRAY_SIZE(qc71_fan_pwm_addrs))
 		return -EINVAL;
 
-	return ec_write_byte(qc71_fan_pwm_addrs[fan_index],
-			     fixp_linear_interpolate(0, 0,
-						     U8_MAX, FAN_MAX_PWM,
-						     pwm));
+	raw = fixp_linear_interpolate(0, 0, U8_MAX, FAN_MAX_PWM, pwm);
+	err = ec_write_byte(qc71_fan_pwm_addrs[fan_index], raw);
+
+	trace_qc71_fan_pwm_set(fan_index, pwm, raw, err);
+
+	return err;
 }
 
-int qc71_fan_get_temp(uint8_t fan_index)
+int qc71_fan_get_temp(uint8_t fan_index, unsigned int max_age_ms)
 {
-	if (fan_index >= ARRAY_SIZE(qc71_fan_temp_addrs))
+	if (fan_index >= ARRAY_SIZE(qc71_fan_temp_sensors))
 		return -EINVAL;
 
-	return ec_read_byte(qc71_fan_temp_addrs[fan_index]);
+	return qc71_sensor_read(qc71_fan_temp_sensors[fan_index], max_age_ms);
+}
+
+unsigned int qc71_fan_ctrl_write_count(void)
+{
+	return atomic_read(&fan_ctrl_writes);
 }
 
 int qc71_fan_get_mode(void)
@@ -167,46 +195,68 @@ int qc71_fan_get_mode(void)
 	return err;
 }
 
-int qc71_fan_set_mode(uint8_t mode)
+/*
+ * the setters take 'fan_lock' uninterruptibly, so that leaving determinism
+ * mode can restore the fans even if a signal is pending while unloading
+ */
+int qc71_fan_set_mode(uint8_t mode, enum qc71_fan_mode_source source)
 {
-	int err, oldpwm;
+	int err, oldpwm, oldmode = -1;
 
-	err = mutex_lock_interruptible(&fan_lock);
-	if (err)
-		return err;
+	mutex_lock(&fan_lock);
+
+	/* costs extra EC reads, so only done when someone is listening */
+	if (trace_qc71_fan_mode_change_enabled())
+		oldmode = qc71_fan_get_mode_unlocked();
 
 	switch (mode) {
 	case 0:
-		err = ec_write_byte(FAN_CTRL_ADDR, FAN_CTRL_FAN_BOOST);
+		err = qc71_fan_write_ctrl(FAN_CTRL_FAN_BOOST);
 		if (err)
 			goto out;
 
 		err = qc71_fan_set_pwm(0, FAN_MAX_PWM);
 		break;
 	case 1:
-		oldpwm = err = qc71_fan_get_pwm(0);
+		oldpwm = err = qc71_fan_get_pwm(0, 0);
 		if (err < 0)
 			goto out;
 
-		err = ec_write_byte(FAN_CTRL_ADDR, FAN_CTRL_FAN_BOOST);
+		err = qc71_fan_write_ctrl(FAN_CTRL_FAN_BOOST);
 		if (err < 0)
 			goto out;
 
 		err = qc71_fan_set_pwm(0, oldpwm);
 		if (err < 0)
-			(void) ec_write_byte(FAN_CTRL_ADDR, 0x80 | FAN_CTRL_AUTO);
+			(void) qc71_fan_write_ctrl(0x80 | FAN_CTRL_AUTO);
 			/* try to restore automatic fan control */
 
 		break;
 	case 2:
-		err = ec_write_byte(FAN_CTRL_ADDR, 0x80 | FAN_CTRL_AUTO);
+		err = qc71_fan_write_ctrl(0x80 | FAN_CTRL_AUTO);
 		break;
 	default:
 		err = -EINVAL;
 		break;
 	}
 
+	if (!err)
+		trace_qc71_fan_mode_change(oldmode, mode, source);
+
 out:
 	mutex_unlock(&fan_lock);
 	return err;
 }
+
+/* writes a raw FAN_CTRL_ADDR value, e.g. one that has been saved earlier */
+int qc71_fan_set_ctrl(uint8_t value)
+{
+	int err;
+
+	mutex_lock(&fan_lock);
+
+	err = qc71_fan_write_ctrl(value);
+
+	mutex_unlock(&fan_lock);
+	return err;
+}
@@ -11,12 +11,31 @@
 
 /* ========================================================================== */
 
-int qc71_fan_get_rpm(uint8_t fan_index);
+/* who requested a fan mode change, for tracing */
+enum qc71_fan_mode_source {
+	QC71_FAN_MODE_SOURCE_HWMON,
+	QC71_FAN_MODE_SOURCE_DETERMINISM,
+};
+
+/* ========================================================================== */
+
+/* the getters return values read at most 'max_age_ms' milliseconds ago, see qc71_sensor_read() */
+int qc71_fan_get_rpm(uint8_t fan_index, unsigned int max_age_ms);
 int qc71_fan_query_abnorm(void);
-int qc71_fan_get_pwm(uint8_t fan_index);
+int qc71_fan_get_pwm(uint8_t fan_index, unsigned int max_age_ms);
 int qc71_fan_set_pwm(uint8_t fan_index, uint8_t pwm);
-int qc71_fan_get_temp(uint8_t fan_index);
+int qc71_fan_get_temp(uint8_t fan_index, unsigned int max_age_ms);
 int qc71_fan_get_mode(void);
-int qc71_fan_set_mode(uint8_t mode);
+int qc71_fan_set_mode(uint8_t mode, enum qc71_fan_mode_source source);
+int qc71_fan_set_ctrl(uint8_t value);
+
+#if IS_ENABLED(CONFIG_HWMON)
+unsigned int qc71_fan_ctrl_write_count(void);
+#else
+static inline unsigned int qc71_fan_ctrl_write_count(void)
+{
+	return 0;
+}
+#endif
 
 #endif /* QC71_LAPTOP_FAN_H */
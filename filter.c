@@ -0,0 +1,171 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "pr.h"
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/moduleparam.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+#include <linux/types.h>
+
+#include "filter.h"
+#include "sampler.h"
+
+/* ========================================================================== */
+/*
+ * the values of the periodic sampling are filtered to provide a stable input
+ * for control loops, either with an exponential moving average whose smoothing
+ * factor is 2 / (window + 1), or by taking the median of the last 'window' samples
+ */
+
+#define FILTER_MODE_NONE   0
+#define FILTER_MODE_EMA    1
+#define FILTER_MODE_MEDIAN 2
+
+#define FILTER_MAX_WINDOW 16
+
+/* fixed point scale of the moving average */
+#define FILTER_EMA_SHIFT 10
+
+/* ========================================================================== */
+
+static unsigned int filter_mode;
+module_param(filter_mode, uint, 0444);
+MODULE_PARM_DESC(filter_mode, "filtering of fan speeds and temperatures: 0 - none, 1 - exponential moving average, 2 - median (default=0)");
+
+static unsigned int filter_window = 5;
+module_param(filter_window, uint, 0644);
+MODULE_PARM_DESC(filter_window, "number of samples the filter considers, at most 16 (default=5)");
+
+/* ========================================================================== */
+
+struct qc71_filter_state {
+	unsigned int count; /* number of values seen, saturates at FILTER_MAX_WINDOW */
+	unsigned int head;
+	int history[FILTER_MAX_WINDOW];
+	s64 ema; /* scaled by 2^FILTER_EMA_SHIFT */
+};
+
+static DEFINE_SPINLOCK(filter_lock);
+static struct qc71_filter_state filter_states[QC71_FILTER_CHANNEL_COUNT];
+static bool filter_consumer_registered;
+
+/* ========================================================================== */
+
+static unsigned int qc71_filter_window(void)
+{
+	return clamp(READ_ONCE(filter_window), 1U, (unsigned int) FILTER_MAX_WINDOW);
+}
+
+static int qc71_filter_median(const struct qc71_filter_state *st)
+{
+	unsigned int i, j, n = min(st->count, qc71_filter_window());
+	int values[FILTER_MAX_WINDOW];
+
+	/* the last 'n' values */
+	for (i = 0; i < n; i++)
+		values[i] = st->history[(st->head + FILTER_MAX_WINDOW - n + i) % FILTER_MAX_WINDOW];
+
+	/* insertion sort, there are at most FILTER_MAX_WINDOW values */
+	for (i = 1; i < n; i++) {
+		int v = values[i];
+
+		for (j = i; j > 0 && values[j - 1] > v; j--)
+			values[j] = values[j - 1];
+
+		values[j] = v;
+	}
+
+	return values[n / 2];
+}
+
+static void qc71_filter_push(struct qc71_filter_state *st, int value)
+{
+	s64 scaled = (s64) value << FILTER_EMA_SHIFT;
+
+	st->history[st->head] = value;
+	st->head = (st->head + 1) % FILTER_MAX_WINDOW;
+
+	if (st->count == 0)
+		st->ema = scaled;
+	else
+		st->ema += div_s64(2 * (scaled - st->ema), qc71_filter_window() + 1);
+
+	if (st->count < FILTER_MAX_WINDOW)
+		st->count += 1;
+}
+
+static void qc71_filter_sample(struct qc71_sampler_consumer *consumer,
+			       const struct qc71_sample *s)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&filter_lock, flags);
+
+	qc71_filter_push(&filter_states[QC71_FILTER_FAN1_RPM],  s->rpm[0]);
+	qc71_filter_push(&filter_states[QC71_FILTER_FAN2_RPM],  s->rpm[1]);
+	qc71_filter_push(&filter_states[QC71_FILTER_FAN1_TEMP], s->temp[0]);
+	qc71_filter_push(&filter_states[QC71_FILTER_FAN2_TEMP], s->temp[1]);
+
+	spin_unlock_irqrestore(&filter_lock, flags);
+}
+
+static struct qc71_sampler_consumer filter_consumer = {
+	.sample = qc71_filter_sample,
+};
+
+/* ========================================================================== */
+
+bool qc71_filter_enabled(void)
+{
+	return filter_consumer_registered;
+}
+
+int qc71_filter_get(enum qc71_filter_channel channel, unsigned int scale)
+{
+	const struct qc71_filter_state *st;
+	unsigned long flags;
+	int value;
+
+	if (channel >= ARRAY_SIZE(filter_states))
+		return -EINVAL;
+
+	if (!filter_consumer_registered)
+		return -EOPNOTSUPP;
+
+	st = &filter_states[channel];
+
+	spin_lock_irqsave(&filter_lock, flags);
+
+	if (st->count == 0)
+		value = -ENODATA;
+	else if (filter_mode == FILTER_MODE_MEDIAN)
+		value = qc71_filter_median(st) * scale;
+	else
+		value = DIV_ROUND_CLOSEST_ULL(st->ema * scale, 1 << FILTER_EMA_SHIFT);
+
+	spin_unlock_irqrestore(&filter_lock, flags);
+
+	return value;
+}
+
+/* ========================================================================== */
+
+int __init qc71_filter_setup(void)
+{
+	if (filter_mode != FILTER_MODE_EMA && filter_mode != FILTER_MODE_MEDIAN)
+		return -ENODEV;
+
+	qc71_sampler_register(&filter_consumer);
+	filter_consumer_registered = true;
+
+	return 0;
+}
+
+void qc71_filter_cleanup(void)
+{
+	if (filter_consumer_registered) {
+		qc71_sampler_unregister(&filter_consumer);
+		filter_consumer_registered = false;
+	}
+}
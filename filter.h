@@ -0,0 +1,31 @@
+// SPDX-License-Identifier: GPL-2.0
+#ifndef QC71_FILTER_H
+#define QC71_FILTER_H
+
+#include <linux/init.h>
+#include <linux/types.h>
+
+/* ========================================================================== */
+
+enum qc71_filter_channel {
+	QC71_FILTER_FAN1_RPM,
+	QC71_FILTER_FAN2_RPM,
+	QC71_FILTER_FAN1_TEMP,
+	QC71_FILTER_FAN2_TEMP,
+	QC71_FILTER_CHANNEL_COUNT
+};
+
+/* ========================================================================== */
+
+bool qc71_filter_enabled(void);
+
+/*
+ * returns the filtered value of the channel multiplied by 'scale', rounded
+ * only after the scaling, or a negative errno
+ */
+int qc71_filter_get(enum qc71_filter_channel channel, unsigned int scale);
+
+int  __init qc71_filter_setup(void);
+void        qc71_filter_cleanup(void);
+
+#endif /* QC71_FILTER_H */
@@ -11,23 +11,45 @@
 #include "ec.h"
 #include "fan.h"
 #include "features.h"
+#include "filter.h"
 #include "hwmon_fan.h"
 #include "pdev.h"
+#include "sensor.h"
+
+/*
+ * channels 0 and 1 are the raw values, channels 2 and 3 are
+ * the filtered values of the same sensors, see filter.c
+ */
+#define FILTERED_CHANNEL_OFFSET 2
 
 /* ========================================================================== */
 
 static struct device *qc71_hwmon_fan_dev;
 
+static const enum qc71_filter_channel rpm_filter_channels[] = {
+	QC71_FILTER_FAN1_RPM,
+	QC71_FILTER_FAN2_RPM,
+};
+
+static const enum qc71_filter_channel temp_filter_channels[] = {
+	QC71_FILTER_FAN1_TEMP,
+	QC71_FILTER_FAN2_TEMP,
+};
+
 /* ========================================================================== */
 
 static umode_t qc71_hwmon_fan_is_visible(const void *data, enum hwmon_sensor_types type,
 					 u32 attr, int channel)
 {
+	if (channel >= FILTERED_CHANNEL_OFFSET && !qc71_filter_enabled())
+		return 0;
+
 	switch (type) {
 	case hwmon_fan:
 		switch (attr) {
 		case hwmon_fan_input:
 		case hwmon_fan_fault:
+		case hwmon_fan_label:
 			return 0444;
 		}
 		break;
@@ -53,7 +75,11 @@ static int qc71_hwmon_fan_read(struct device *device, enum hwmon_sensor_types ty
 	case hwmon_fan:
 		switch (attr) {
 		case hwmon_fan_input:
-			err = qc71_fan_get_rpm(channel);
+			if (channel >= FILTERED_CHANNEL_OFFSET)
+				err = qc71_filter_get(rpm_filter_channels[channel - FILTERED_CHANNEL_OFFSET], 1);
+			else
+				err = qc71_fan_get_rpm(channel, qc71_sensor_default_max_age());
+
 			if (err < 0)
 				return err;
 
@@ -66,11 +92,20 @@ static int qc71_hwmon_fan_read(struct device *device, enum hwmon_sensor_types ty
 	case hwmon_temp:
 		switch (attr) {
 		case hwmon_temp_input:
-			err = qc71_fan_get_temp(channel);
-			if (err < 0)
-				return err;
-
-			*value = err * 1000;
+			if (channel >= FILTERED_CHANNEL_OFFSET) {
+				/* in millidegrees, to keep the precision of the average */
+				err = qc71_filter_get(temp_filter_channels[channel - FILTERED_CHANNEL_OFFSET], 1000);
+				if (err < 0)
+					return err;
+
+				*value = err;
+			} else {
+				err = qc71_fan_get_temp(channel, qc71_sensor_default_max_age());
+				if (err < 0)
+					return err;
+
+				*value = err * 1000;
+			}
 			break;
 		default:
 			return -EOPNOTSUPP;
@@ -86,12 +121,29 @@ static int qc71_hwmon_fan_read(struct device *device, enum hwmon_sensor_types ty
 static int qc71_hwmon_fan_read_string(struct device *dev, enum hwmon_sensor_types type,
 				      u32 attr, int channel, const char **str)
 {
+	static const char * const fan_labels[] = {
+		"fan1",
+		"fan2",
+		"fan1_filtered",
+		"fan2_filtered",
+	};
 	static const char * const temp_labels[] = {
 		"fan1_temp",
 		"fan2_temp",
+		"fan1_temp_filtered",
+		"fan2_temp_filtered",
 	};
 
 	switch (type) {
+	case hwmon_fan:
+		switch (attr) {
+		case hwmon_fan_label:
+			*str = fan_labels[channel];
+			break;
+		default:
+			return -EOPNOTSUPP;
+		}
+		break;
 	case hwmon_temp:
 		switch (attr) {
 		case hwmon_temp_label:
@@ -113,8 +165,12 @@ static int qc71_hwmon_fan_read_string(struct device *dev, enum hwmon_sensor_type
 static const struct hwmon_channel_info *qc71_hwmon_fan_ch_info[] = {
 	HWMON_CHANNEL_INFO(fan,
 			   HWMON_F_INPUT,
-			   HWMON_F_INPUT),
+			   HWMON_F_INPUT,
+			   HWMON_F_INPUT | HWMON_F_LABEL,
+			   HWMON_F_INPUT | HWMON_F_LABEL),
 	HWMON_CHANNEL_INFO(temp,
+			   HWMON_T_INPUT | HWMON_T_LABEL,
+			   HWMON_T_INPUT | HWMON_T_LABEL,
 			   HWMON_T_INPUT | HWMON_T_LABEL,
 			   HWMON_T_INPUT | HWMON_T_LABEL),
 	NULL
@@ -10,10 +10,12 @@
 #include <linux/sysfs.h>
 #include <linux/types.h>
 
+#include "determinism.h"
 #include "fan.h"
 #include "features.h"
 #include "hwmon_pwm.h"
 #include "pdev.h"
+#include "sensor.h"
 
 /* ========================================================================== */
 
@@ -46,7 +48,7 @@ static int qc71_hwmon_pwm_read(struct device *device, enum hwmon_sensor_types ty
 			*value = err;
 			break;
 		case hwmon_pwm_input:
-			err = qc71_fan_get_pwm(channel);
+			err = qc71_fan_get_pwm(channel, qc71_sensor_default_max_age());
 			if (err < 0)
 				return err;
 
@@ -66,21 +68,30 @@ static int qc71_hwmon_pwm_read(struct device *device, enum hwmon_sensor_types ty
 static int qc71_hwmon_pwm_write(struct device *device, enum hwmon_sensor_types type,
 			    u32 attr, int channel, long value)
 {
-	switch (type) {
-	case hwmon_pwm:
-		switch (attr) {
-		case hwmon_pwm_enable:
-			return qc71_fan_set_mode(value);
-		case hwmon_pwm_input:
-			return qc71_fan_set_pwm(channel, value);
-		default:
-			return -EOPNOTSUPP;
-		}
-	default:
+	int err;
+
+	if (type != hwmon_pwm)
 		return -EOPNOTSUPP;
+
+	err = qc71_determinism_write_begin();
+	if (err)
+		return err;
+
+	switch (attr) {
+	case hwmon_pwm_enable:
+		err = qc71_fan_set_mode(value, QC71_FAN_MODE_SOURCE_HWMON);
+		break;
+	case hwmon_pwm_input:
+		err = qc71_fan_set_pwm(channel, value);
+		break;
+	default:
+		err = -EOPNOTSUPP;
+		break;
 	}
 
-	return 0;
+	qc71_determinism_write_end();
+
+	return err;
 }
 
 static const struct hwmon_channel_info *qc71_hwmon_pwm_ch_info[] = {
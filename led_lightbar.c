@@ -12,6 +12,8 @@
 #include "features.h"
 #include "led_lightbar.h"
 #include "pdev.h"
+#include "sensor.h"
+#include "tracing.h"
 
 /* ========================================================================== */
 
@@ -117,10 +119,14 @@ static int qc71_lightbar_switch(uint8_t mask, bool on)
 
 	status = qc71_lightbar_get_status();
 
-	if (status < 0)
-		return status;
+	if (status >= 0)
+		status = qc71_lightbar_write_ctrl(SET_BIT(status, mask, !on));
+
+	trace_qc71_lightbar_update(mask == LIGHTBAR_CTRL_S0_OFF ?
+				   QC71_LIGHTBAR_FIELD_S0 : QC71_LIGHTBAR_FIELD_S3,
+				   on, min(status, 0));
 
-	return qc71_lightbar_write_ctrl(SET_BIT(status, mask, !on));
+	return status;
 }
 
 static int qc71_lightbar_set_color_level(uint8_t color, uint8_t level)
@@ -152,14 +158,17 @@ static int qc71_lightbar_set_rainbow_mode(bool on)
 {
 	int status = qc71_lightbar_get_status();
 
-	if (status < 0)
-		return status;
+	if (status >= 0)
+		status = qc71_lightbar_write_ctrl(SET_BIT(status, LIGHTBAR_CTRL_RAINBOW, on));
 
-	return qc71_lightbar_write_ctrl(SET_BIT(status, LIGHTBAR_CTRL_RAINBOW, on));
+	trace_qc71_lightbar_update(QC71_LIGHTBAR_FIELD_RAINBOW, on, min(status, 0));
+
+	return status;
 }
 
 static int qc71_lightbar_set_color(unsigned int color)
 {
+	unsigned int value = color;
 	int err = 0, i;
 
 	if (color > 999) /* color must lie in [0, 999] */
@@ -169,6 +178,8 @@ static int qc71_lightbar_set_color(unsigned int color)
 		err = qc71_lightbar_set_color_level(lightbar_colors[i],
 						    do_div(color, 10));
 
+	trace_qc71_lightbar_update(QC71_LIGHTBAR_FIELD_COLOR, value, err);
+
 	return err;
 }
 
@@ -270,12 +281,12 @@ static ssize_t lightbar_rainbow_store(struct device *dev, struct device_attribut
 
 static enum led_brightness qc71_lightbar_led_get_brightness(struct led_classdev *led_cdev)
 {
-	int err = qc71_lightbar_get_status();
+	int status = qc71_sensor_read(QC71_SENSOR_LIGHTBAR_CTRL, qc71_sensor_default_max_age());
 
-	if (err)
+	if (status < 0)
 		return 0;
 
-	return !(err & LIGHTBAR_CTRL_S0_OFF);
+	return !(status & LIGHTBAR_CTRL_S0_OFF);
 }
 
 static int qc71_lightbar_led_set_brightness(struct led_classdev *led_cdev,
@@ -22,17 +22,24 @@
 #include <linux/types.h>
 #include <linux/wmi.h>
 
+#include "calibration.h"
 #include "ec.h"
 #include "features.h"
 #include "wmi.h"
 
 /* submodules */
 #include "pdev.h"
+#include "sampler.h"
+#include "filter.h"
 #include "events.h"
 #include "hwmon.h"
+#include "determinism.h"
 #include "battery.h"
 #include "led_lightbar.h"
 #include "debugfs.h"
+#include "recorder.h"
+#include "sketch.h"
+#include "telemetry.h"
 
 /* ========================================================================== */
 
@@ -48,11 +55,17 @@ static struct qc71_submodule {
 	void (*cleanup)(void);
 } qc71_submodules[] __refdata = {
 	SUBMODULE_ENTRY(pdev, true), /* must be first */
+	SUBMODULE_ENTRY(sampler, false), /* must precede its consumers */
+	SUBMODULE_ENTRY(filter, false), /* must precede hwmon */
 	SUBMODULE_ENTRY(wmi_events, false),
 	SUBMODULE_ENTRY(hwmon, false),
+	SUBMODULE_ENTRY(determinism, false),
 	SUBMODULE_ENTRY(battery, false),
 	SUBMODULE_ENTRY(led_lightbar, false),
 	SUBMODULE_ENTRY(debugfs, false),
+	SUBMODULE_ENTRY(recorder, false), /* must follow debugfs */
+	SUBMODULE_ENTRY(telemetry, false), /* must follow debugfs */
+	SUBMODULE_ENTRY(sketch, false), /* must follow debugfs */
 };
 
 #undef SUBMODULE_ENTRY
@@ -109,6 +122,10 @@ static int __init qc71_laptop_module_init(void)
 	if (qc71_features.fan_extras)        pr_cont(" fan-extras");
 	pr_cont("\n");
 
+	err = qc71_calibrate();
+	if (err)
+		pr_warn("cannot measure EC latency, using default settings: %d\n", err);
+
 	for (i = 0; i < ARRAY_SIZE(qc71_submodules); i++) {
 		struct qc71_submodule *sm = &qc71_submodules[i];
 
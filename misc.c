@@ -1,17 +1,39 @@
 // SPDX-License-Identifier: GPL-2.0
 #include "pr.h"
 
+#include <linux/bitfield.h>
 #include <linux/bug.h>
 #include <linux/device.h>
 #include <linux/kernel.h>
+#include <linux/mutex.h>
 #include <linux/platform_device.h>
 
 #include "ec.h"
 #include "misc.h"
+#include "sensor.h"
 #include "util.h"
 
 /* ========================================================================== */
 
+/*
+ * CTRL_2_ADDR also contains the turbo level, which the EC may change on its
+ * own, so the cached value is only trusted for a short time, and it is
+ * dropped when an event suggests that it has changed
+ */
+#define KBD_BL_MAX_AGE_MS 2000
+
+/*
+ * level 0 is the backlight turned off, the others are the brightness field + 1,
+ * this only bounds what the field can hold, the caller provides the real limit
+ */
+#define KBD_BL_FIELD_MAX_LEVEL \
+	((int) FIELD_GET(CTRL_2_SINGLE_COLOR_KBD_BRIGHTNESS, CTRL_2_SINGLE_COLOR_KBD_BRIGHTNESS) + 1)
+
+/* serializes the read-modify-write of the brightness */
+static DEFINE_MUTEX(kbd_bl_lock);
+
+/* ========================================================================== */
+
 int qc71_rfkill_get_wifi_state(void)
 {
 	int err = ec_read_byte(DEVICE_STATUS_ADDR);
@@ -24,9 +46,9 @@ int qc71_rfkill_get_wifi_state(void)
 
 /* ========================================================================== */
 
-int qc71_fn_lock_get_state(void)
+int qc71_fn_lock_get_state(unsigned int max_age_ms)
 {
-	int status = ec_read_byte(BIOS_CTRL_1_ADDR);
+	int status = qc71_sensor_read(QC71_SENSOR_BIOS_CTRL_1, max_age_ms);
 
 	if (status < 0)
 		return status;
@@ -36,12 +58,67 @@ int qc71_fn_lock_get_state(void)
 
 int qc71_fn_lock_set_state(bool state)
 {
-	int status = ec_read_byte(BIOS_CTRL_1_ADDR);
+	int status = qc71_sensor_read(QC71_SENSOR_BIOS_CTRL_1, 0);
 
 	if (status < 0)
 		return status;
 
 	status = SET_BIT(status, BIOS_CTRL_1_FN_LOCK_STATUS, state);
 
-	return ec_write_byte(BIOS_CTRL_1_ADDR, status);
+	return qc71_sensor_write(QC71_SENSOR_BIOS_CTRL_1, status);
+}
+
+/* ========================================================================== */
+
+void qc71_kbd_backlight_invalidate(void)
+{
+	qc71_sensor_invalidate(QC71_SENSOR_CTRL_2);
+}
+
+/* returns the new level, 0 means that the backlight is off */
+int qc71_kbd_backlight_step(int delta, int max_level)
+{
+	int status, level, new_level;
+
+	status = mutex_lock_interruptible(&kbd_bl_lock);
+	if (status)
+		return status;
+
+	status = qc71_sensor_read(QC71_SENSOR_CTRL_2, KBD_BL_MAX_AGE_MS);
+	if (status < 0)
+		goto out;
+
+	if (!(status & CTRL_2_SINGLE_COLOR_KEYBOARD)) {
+		status = -EOPNOTSUPP;
+		goto out;
+	}
+
+	if (status & CTRL_2_SINGLE_COLOR_KBD_BL_OFF)
+		level = 0;
+	else
+		level = FIELD_GET(CTRL_2_SINGLE_COLOR_KBD_BRIGHTNESS, status) + 1;
+
+	max_level = min(max_level, KBD_BL_FIELD_MAX_LEVEL);
+
+	/* stepping up does not lower a level above the limit, e.g. set by the firmware */
+	new_level = clamp(level + delta, 0, max(max_level, level));
+
+	if (new_level != level) {
+		if (new_level == 0) {
+			status |= CTRL_2_SINGLE_COLOR_KBD_BL_OFF;
+		} else {
+			status &= ~(CTRL_2_SINGLE_COLOR_KBD_BL_OFF | CTRL_2_SINGLE_COLOR_KBD_BRIGHTNESS);
+			status |= FIELD_PREP(CTRL_2_SINGLE_COLOR_KBD_BRIGHTNESS, new_level - 1);
+		}
+
+		status = qc71_sensor_write(QC71_SENSOR_CTRL_2, status);
+		if (status < 0)
+			goto out;
+	}
+
+	status = new_level;
+
+out:
+	mutex_unlock(&kbd_bl_lock);
+	return status;
 }
@@ -8,7 +8,10 @@
 
 int qc71_rfkill_get_wifi_state(void);
 
-int qc71_fn_lock_get_state(void);
+int qc71_fn_lock_get_state(unsigned int max_age_ms);
 int qc71_fn_lock_set_state(bool state);
 
+void qc71_kbd_backlight_invalidate(void);
+int  qc71_kbd_backlight_step(int delta, int max_level);
+
 #endif /* QC71_MISC_H */
@@ -8,10 +8,12 @@
 #include <linux/platform_device.h>
 
 #include "util.h"
+#include "determinism.h"
 #include "ec.h"
 #include "features.h"
 #include "misc.h"
 #include "pdev.h"
+#include "sensor.h"
 
 /* ========================================================================== */
 
@@ -19,6 +21,39 @@ struct platform_device *qc71_platform_dev;
 
 /* ========================================================================== */
 
+static ssize_t determinism_mode_show(struct device *dev,
+				     struct device_attribute *attr, char *buf)
+{
+	int status = qc71_determinism_get();
+
+	if (status < 0)
+		return status;
+
+	return sprintf(buf, "%d\n", status);
+}
+
+static ssize_t determinism_mode_store(struct device *dev, struct device_attribute *attr,
+				      const char *buf, size_t count)
+{
+	int status;
+	bool value;
+
+	if (kstrtobool(buf, &value))
+		return -EINVAL;
+
+	status = qc71_determinism_set(value);
+	if (status < 0)
+		return status;
+
+	return count;
+}
+
+static ssize_t determinism_drift_show(struct device *dev,
+				      struct device_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", qc71_determinism_drift_count());
+}
+
 static ssize_t fan_reduced_duty_cycle_show(struct device *dev,
 					   struct device_attribute *attr, char *buf)
 {
@@ -39,13 +74,17 @@ static ssize_t fan_reduced_duty_cycle_store(struct device *dev, struct device_at
 	if (kstrtobool(buf, &value))
 		return -EINVAL;
 
-	status = ec_read_byte(BIOS_CTRL_3_ADDR);
-	if (status < 0)
+	status = qc71_determinism_write_begin();
+	if (status)
 		return status;
 
-	status = SET_BIT(status, BIOS_CTRL_3_FAN_REDUCED_DUTY_CYCLE, value);
+	status = ec_read_byte(BIOS_CTRL_3_ADDR);
+	if (status >= 0) {
+		status = SET_BIT(status, BIOS_CTRL_3_FAN_REDUCED_DUTY_CYCLE, value);
+		status = ec_write_byte(BIOS_CTRL_3_ADDR, status);
+	}
 
-	status = ec_write_byte(BIOS_CTRL_3_ADDR, status);
+	qc71_determinism_write_end();
 
 	if (status < 0)
 		return status;
@@ -73,13 +112,17 @@ static ssize_t fan_always_on_store(struct device *dev, struct device_attribute *
 	if (kstrtobool(buf, &value))
 		return -EINVAL;
 
-	status = ec_read_byte(BIOS_CTRL_3_ADDR);
-	if (status < 0)
+	status = qc71_determinism_write_begin();
+	if (status)
 		return status;
 
-	status = SET_BIT(status, BIOS_CTRL_3_FAN_ALWAYS_ON, value);
+	status = ec_read_byte(BIOS_CTRL_3_ADDR);
+	if (status >= 0) {
+		status = SET_BIT(status, BIOS_CTRL_3_FAN_ALWAYS_ON, value);
+		status = ec_write_byte(BIOS_CTRL_3_ADDR, status);
+	}
 
-	status = ec_write_byte(BIOS_CTRL_3_ADDR, status);
+	qc71_determinism_write_end();
 
 	if (status < 0)
 		return status;
@@ -90,7 +133,7 @@ static ssize_t fan_always_on_store(struct device *dev, struct device_attribute *
 static ssize_t fn_lock_show(struct device *dev,
 			    struct device_attribute *attr, char *buf)
 {
-	int status = qc71_fn_lock_get_state();
+	int status = qc71_fn_lock_get_state(qc71_sensor_default_max_age());
 
 	if (status < 0)
 		return status;
@@ -168,13 +211,17 @@ static ssize_t manual_control_store(struct device *dev, struct device_attribute
 	if (kstrtobool(buf, &value))
 		return -EINVAL;
 
-	status = ec_read_byte(CTRL_1_ADDR);
-	if (status < 0)
+	status = qc71_determinism_write_begin();
+	if (status)
 		return status;
 
-	status = SET_BIT(status, CTRL_1_MANUAL_MODE, value);
+	status = ec_read_byte(CTRL_1_ADDR);
+	if (status >= 0) {
+		status = SET_BIT(status, CTRL_1_MANUAL_MODE, value);
+		status = ec_write_byte(CTRL_1_ADDR, status);
+	}
 
-	status = ec_write_byte(CTRL_1_ADDR, status);
+	qc71_determinism_write_end();
 
 	if (status < 0)
 		return status;
@@ -218,6 +265,8 @@ static ssize_t super_key_lock_store(struct device *dev, struct device_attribute
 
 /* ========================================================================== */
 
+static DEVICE_ATTR_RW(determinism_mode);
+static DEVICE_ATTR_RO(determinism_drift);
 static DEVICE_ATTR_RW(fn_lock);
 static DEVICE_ATTR_RW(fn_lock_switch);
 static DEVICE_ATTR_RW(fan_always_on);
@@ -226,6 +275,8 @@ static DEVICE_ATTR_RW(manual_control);
 static DEVICE_ATTR_RW(super_key_lock);
 
 static struct attribute *qc71_laptop_attrs[] = {
+	&dev_attr_determinism_mode.attr,
+	&dev_attr_determinism_drift.attr,
 	&dev_attr_fn_lock.attr,
 	&dev_attr_fn_lock_switch.attr,
 	&dev_attr_fan_always_on.attr,
@@ -241,7 +292,9 @@ static umode_t qc71_laptop_attr_is_visible(struct kobject *kobj, struct attribut
 {
 	bool ok = false;
 
-	if (attr == &dev_attr_fn_lock.attr || attr == &dev_attr_fn_lock_switch.attr)
+	if (attr == &dev_attr_determinism_mode.attr || attr == &dev_attr_determinism_drift.attr)
+		ok = IS_ENABLED(CONFIG_HWMON) && qc71_features.fan_boost;
+	else if (attr == &dev_attr_fn_lock.attr || attr == &dev_attr_fn_lock_switch.attr)
 		ok = qc71_features.fn_lock;
 	else if (attr == &dev_attr_fan_always_on.attr || attr == &dev_attr_fan_reduced_duty_cycle.attr)
 		ok = qc71_features.fan_extras;
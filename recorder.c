@@ -0,0 +1,400 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "pr.h"
+
+#include <linux/debugfs.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/types.h>
+#include <linux/uaccess.h>
+
+#include "debugfs.h"
+#include "ec.h"
+#include "recorder.h"
+#include "sampler.h"
+
+/* ========================================================================== */
+/*
+ * thermal flight recorder: while armed, the last 'pre_samples' samples are
+ * kept in a ring buffer, and when one of the enabled triggers fires, they are
+ * frozen together with the next 'post_samples' samples into a numbered capture
+ * that appears in debugfs as 'recorder/captures/<id>'
+ */
+
+#define RECORDER_TRIGGER_FAN_ABNORMAL   BIT(0)
+#define RECORDER_TRIGGER_TEMP_THRESHOLD BIT(1)
+#define RECORDER_TRIGGER_FAN_CTRL       BIT(2) /* FAN_CTRL_ADDR changed by someone else */
+
+#define RECORDER_MAX_SAMPLES  600
+#define RECORDER_MAX_CAPTURES 8
+
+/* ========================================================================== */
+
+struct qc71_recorder_capture {
+	struct list_head node;
+	unsigned int id;
+	unsigned int trigger;
+	struct dentry *dentry;
+
+	size_t trigger_index; /* index of the sample that fired the trigger */
+	size_t count, capacity;
+	struct qc71_sample samples[];
+};
+
+/* ========================================================================== */
+
+/* serializes arming and disarming, held across (un)registering the consumer */
+static DEFINE_MUTEX(recorder_transition_lock);
+
+static DEFINE_MUTEX(recorder_lock);
+
+static struct dentry *recorder_dir, *recorder_captures_dir;
+
+static u32 recorder_triggers = RECORDER_TRIGGER_FAN_ABNORMAL |
+			       RECORDER_TRIGGER_TEMP_THRESHOLD |
+			       RECORDER_TRIGGER_FAN_CTRL;
+static u32 recorder_temp_threshold = 90;
+static u32 recorder_pre_samples = 30;
+static u32 recorder_post_samples = 30;
+
+/* the following are protected by 'recorder_lock' */
+static bool recorder_armed;
+static struct qc71_sample *recorder_ring;
+static size_t recorder_ring_size, recorder_ring_head, recorder_ring_count;
+static struct qc71_recorder_capture *recorder_pending;
+static LIST_HEAD(recorder_captures);
+static size_t recorder_capture_count;
+static unsigned int recorder_next_id;
+
+/* ========================================================================== */
+
+static int qc71_recorder_capture_show(struct seq_file *m, void *unused)
+{
+	unsigned int id = (uintptr_t) m->private;
+	struct qc71_recorder_capture *c;
+	size_t i;
+	int err;
+
+	err = mutex_lock_interruptible(&recorder_lock);
+	if (err)
+		return err;
+
+	err = -ENOENT;
+
+	list_for_each_entry (c, &recorder_captures, node) {
+		const struct qc71_sample *t;
+
+		if (c->id != id)
+			continue;
+
+		t = &c->samples[c->trigger_index];
+
+		seq_printf(m, "# capture %u trigger=%#x samples=%zu trigger_index=%zu\n",
+			   c->id, c->trigger, c->count, c->trigger_index);
+		seq_puts(m, "# t_ms rpm1 rpm2 pwm1 pwm2 temp1 temp2 ctrl_1 ctrl_2 fan_ctrl bios_ctrl_3 pl1 pl2 pl4\n");
+
+		for (i = 0; i < c->count; i++) {
+			const struct qc71_sample *s = &c->samples[i];
+
+			seq_printf(m, "%lld %u %u %u %u %u %u %#04x %#04x %#04x %#04x %u %u %u\n",
+				   div_s64((s64) (s->timestamp - t->timestamp), NSEC_PER_MSEC),
+				   s->rpm[0], s->rpm[1], s->pwm[0], s->pwm[1],
+				   s->temp[0], s->temp[1],
+				   s->ctrl_1, s->ctrl_2, s->fan_ctrl, s->bios_ctrl_3,
+				   s->pl1, s->pl2, s->pl4);
+		}
+
+		err = 0;
+		break;
+	}
+
+	mutex_unlock(&recorder_lock);
+
+	return err;
+}
+DEFINE_SHOW_ATTRIBUTE(qc71_recorder_capture);
+
+/* ========================================================================== */
+
+static const struct qc71_sample *qc71_recorder_ring_at(size_t i)
+{
+	/* 0 is the oldest sample */
+	return &recorder_ring[(recorder_ring_head + recorder_ring_size - recorder_ring_count + i) %
+			      recorder_ring_size];
+}
+
+static void qc71_recorder_ring_push(const struct qc71_sample *s)
+{
+	recorder_ring[recorder_ring_head] = *s;
+	recorder_ring_head = (recorder_ring_head + 1) % recorder_ring_size;
+
+	if (recorder_ring_count < recorder_ring_size)
+		recorder_ring_count += 1;
+}
+
+static unsigned int qc71_recorder_check_triggers(const struct qc71_sample *prev,
+						 const struct qc71_sample *cur)
+{
+	u32 enabled = READ_ONCE(recorder_triggers), threshold = READ_ONCE(recorder_temp_threshold);
+	unsigned int fired = 0;
+	size_t i;
+
+	if ((cur->ctrl_1 & CTRL_1_FAN_ABNORMAL) && !(prev->ctrl_1 & CTRL_1_FAN_ABNORMAL))
+		fired |= RECORDER_TRIGGER_FAN_ABNORMAL;
+
+	for (i = 0; i < ARRAY_SIZE(cur->temp); i++)
+		if (cur->temp[i] >= threshold && prev->temp[i] < threshold)
+			fired |= RECORDER_TRIGGER_TEMP_THRESHOLD;
+
+	if (cur->fan_ctrl != prev->fan_ctrl && cur->fan_ctrl_writes == prev->fan_ctrl_writes)
+		fired |= RECORDER_TRIGGER_FAN_CTRL;
+
+	return fired & enabled;
+}
+
+/*
+ * the debugfs file of the evicted capture is returned, and it must be removed
+ * after releasing 'recorder_lock' since removal waits for the readers
+ */
+static struct dentry *qc71_recorder_evict_oldest(void)
+{
+	struct qc71_recorder_capture *c =
+		list_first_entry(&recorder_captures, struct qc71_recorder_capture, node);
+	struct dentry *dentry = c->dentry;
+
+	list_del(&c->node);
+	recorder_capture_count -= 1;
+
+	kfree(c);
+
+	return dentry;
+}
+
+static void qc71_recorder_finish_capture(struct dentry **stale)
+{
+	struct qc71_recorder_capture *c = recorder_pending;
+	char name[16];
+
+	recorder_pending = NULL;
+
+	if (recorder_capture_count >= RECORDER_MAX_CAPTURES)
+		*stale = qc71_recorder_evict_oldest();
+
+	list_add_tail(&c->node, &recorder_captures);
+	recorder_capture_count += 1;
+
+	snprintf(name, sizeof(name), "%u", c->id);
+	c->dentry = debugfs_create_file(name, 0400, recorder_captures_dir,
+					(void *)(uintptr_t) c->id, &qc71_recorder_capture_fops);
+
+	pr_info("capture %u finished (trigger=%#x, samples=%zu)\n",
+		c->id, c->trigger, c->count);
+}
+
+static void qc71_recorder_start_capture(unsigned int trigger, struct dentry **stale)
+{
+	size_t post = min_t(u32, READ_ONCE(recorder_post_samples), RECORDER_MAX_SAMPLES);
+	size_t i, capacity = recorder_ring_count + post;
+	struct qc71_recorder_capture *c;
+
+	c = kzalloc(struct_size(c, samples, capacity), GFP_KERNEL);
+	if (!c) {
+		pr_warn("cannot allocate capture\n");
+		return;
+	}
+
+	c->id = recorder_next_id++;
+	c->trigger = trigger;
+	c->capacity = capacity;
+
+	/* the ring already contains the sample that fired the trigger */
+	for (i = 0; i < recorder_ring_count; i++)
+		c->samples[i] = *qc71_recorder_ring_at(i);
+
+	c->count = recorder_ring_count;
+	c->trigger_index = c->count - 1;
+
+	recorder_pending = c;
+
+	pr_info("capture %u triggered (trigger=%#x)\n", c->id, trigger);
+
+	if (c->count == c->capacity)
+		qc71_recorder_finish_capture(stale);
+}
+
+static void qc71_recorder_sample(struct qc71_sampler_consumer *consumer,
+				 const struct qc71_sample *s)
+{
+	struct dentry *stale = NULL;
+	struct qc71_sample prev;
+	unsigned int fired = 0;
+
+	mutex_lock(&recorder_lock);
+
+	if (!recorder_armed)
+		goto out;
+
+	if (recorder_pending) {
+		recorder_pending->samples[recorder_pending->count++] = *s;
+
+		if (recorder_pending->count == recorder_pending->capacity)
+			qc71_recorder_finish_capture(&stale);
+	} else if (recorder_ring_count > 0) {
+		prev = *qc71_recorder_ring_at(recorder_ring_count - 1);
+		fired = qc71_recorder_check_triggers(&prev, s);
+	}
+
+	qc71_recorder_ring_push(s);
+
+	if (fired)
+		qc71_recorder_start_capture(fired, &stale);
+
+out:
+	mutex_unlock(&recorder_lock);
+
+	/* checks if IS_ERR_OR_NULL() */
+	debugfs_remove(stale);
+}
+
+static struct qc71_sampler_consumer recorder_consumer = {
+	.sample = qc71_recorder_sample,
+};
+
+/* ========================================================================== */
+
+static int qc71_recorder_arm(void)
+{
+	size_t size = clamp_t(u32, READ_ONCE(recorder_pre_samples), 1, RECORDER_MAX_SAMPLES);
+	struct qc71_sample *ring;
+
+	ring = kcalloc(size, sizeof(*ring), GFP_KERNEL);
+	if (!ring)
+		return -ENOMEM;
+
+	mutex_lock(&recorder_transition_lock);
+	mutex_lock(&recorder_lock);
+
+	if (recorder_armed) {
+		mutex_unlock(&recorder_lock);
+		mutex_unlock(&recorder_transition_lock);
+		kfree(ring);
+		return 0;
+	}
+
+	recorder_ring = ring;
+	recorder_ring_size = size;
+	recorder_ring_head = 0;
+	recorder_ring_count = 0;
+	recorder_armed = true;
+
+	mutex_unlock(&recorder_lock);
+
+	/* must not be called with 'recorder_lock' held */
+	qc71_sampler_register(&recorder_consumer);
+
+	mutex_unlock(&recorder_transition_lock);
+
+	return 0;
+}
+
+static void qc71_recorder_disarm(void)
+{
+	struct dentry *stale = NULL;
+	bool was_armed;
+
+	mutex_lock(&recorder_transition_lock);
+
+	mutex_lock(&recorder_lock);
+	was_armed = recorder_armed;
+	mutex_unlock(&recorder_lock);
+
+	if (!was_armed)
+		goto out;
+
+	qc71_sampler_unregister(&recorder_consumer);
+
+	mutex_lock(&recorder_lock);
+
+	/* keep what has been collected so far */
+	if (recorder_pending)
+		qc71_recorder_finish_capture(&stale);
+
+	kfree(recorder_ring);
+	recorder_ring = NULL;
+	recorder_ring_size = 0;
+	recorder_ring_count = 0;
+	recorder_armed = false;
+
+	mutex_unlock(&recorder_lock);
+
+	debugfs_remove(stale);
+
+out:
+	mutex_unlock(&recorder_transition_lock);
+}
+
+/* ========================================================================== */
+
+static int qc71_recorder_armed_get(void *data, u64 *value)
+{
+	*value = READ_ONCE(recorder_armed);
+
+	return 0;
+}
+
+static int qc71_recorder_armed_set(void *data, u64 value)
+{
+	if (value)
+		return qc71_recorder_arm();
+
+	qc71_recorder_disarm();
+
+	return 0;
+}
+
+DEFINE_DEBUGFS_ATTRIBUTE(qc71_recorder_armed_fops, qc71_recorder_armed_get,
+			 qc71_recorder_armed_set, "%llu\n");
+
+/* ========================================================================== */
+
+int __init qc71_recorder_setup(void)
+{
+	if (IS_ERR_OR_NULL(qc71_debugfs_dir))
+		return -ENODEV;
+
+	recorder_dir = debugfs_create_dir("recorder", qc71_debugfs_dir);
+	if (IS_ERR(recorder_dir))
+		return PTR_ERR(recorder_dir);
+
+	recorder_captures_dir = debugfs_create_dir("captures", recorder_dir);
+
+	debugfs_create_file_unsafe("armed", 0600, recorder_dir, NULL, &qc71_recorder_armed_fops);
+	debugfs_create_x32("triggers", 0600, recorder_dir, &recorder_triggers);
+	debugfs_create_u32("temp_threshold", 0600, recorder_dir, &recorder_temp_threshold);
+	debugfs_create_u32("pre_samples", 0600, recorder_dir, &recorder_pre_samples);
+	debugfs_create_u32("post_samples", 0600, recorder_dir, &recorder_post_samples);
+
+	return 0;
+}
+
+void qc71_recorder_cleanup(void)
+{
+	qc71_recorder_disarm();
+
+	/* checks if IS_ERR_OR_NULL() */
+	debugfs_remove_recursive(recorder_dir);
+
+	while (!list_empty(&recorder_captures)) {
+		struct qc71_recorder_capture *c =
+			list_first_entry(&recorder_captures, struct qc71_recorder_capture, node);
+
+		list_del(&c->node);
+		kfree(c);
+	}
+
+	recorder_capture_count = 0;
+}
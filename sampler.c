@@ -0,0 +1,163 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "pr.h"
+
+#include <linux/init.h>
+#include <linux/jiffies.h>
+#include <linux/build_bug.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/list.h>
+#include <linux/moduleparam.h>
+#include <linux/mutex.h>
+#include <linux/stddef.h>
+#include <linux/types.h>
+#include <linux/workqueue.h>
+
+#include "calibration.h"
+#include "fan.h"
+#include "sampler.h"
+#include "sensor.h"
+
+/* ========================================================================== */
+
+static unsigned int sample_interval_ms;
+module_param(sample_interval_ms, uint, 0644);
+MODULE_PARM_DESC(sample_interval_ms, "interval of the periodic sensor sampling in milliseconds, 0 derives it from the measured EC latency (default=0)");
+
+/* ========================================================================== */
+
+static DEFINE_MUTEX(sampler_lock);
+static LIST_HEAD(sampler_consumers);
+
+static void qc71_sampler_work_fn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(sampler_work, qc71_sampler_work_fn);
+
+/* ========================================================================== */
+
+struct qc71_sampled_reg {
+	enum qc71_sensor_id sensor;
+	size_t offset;
+	size_t size;
+};
+
+#define SAMPLED_REG(_sensor, _field) { \
+	.sensor = (_sensor), \
+	.offset = offsetof(struct qc71_sample, _field), \
+	.size   = sizeof(((struct qc71_sample *) 0)->_field), \
+}
+
+/* read in this order */
+static const struct qc71_sampled_reg qc71_sampled_regs[] = {
+	SAMPLED_REG(QC71_SENSOR_FAN1_RPM,    rpm[0]),
+	SAMPLED_REG(QC71_SENSOR_FAN2_RPM,    rpm[1]),
+	SAMPLED_REG(QC71_SENSOR_FAN1_PWM,    pwm[0]),
+	SAMPLED_REG(QC71_SENSOR_FAN2_PWM,    pwm[1]),
+	SAMPLED_REG(QC71_SENSOR_FAN1_TEMP,   temp[0]),
+	SAMPLED_REG(QC71_SENSOR_FAN2_TEMP,   temp[1]),
+	SAMPLED_REG(QC71_SENSOR_CTRL_1,      ctrl_1),
+	SAMPLED_REG(QC71_SENSOR_CTRL_2,      ctrl_2),
+	SAMPLED_REG(QC71_SENSOR_FAN_CTRL,    fan_ctrl),
+	SAMPLED_REG(QC71_SENSOR_BIOS_CTRL_3, bios_ctrl_3),
+	SAMPLED_REG(QC71_SENSOR_PL1,         pl1),
+	SAMPLED_REG(QC71_SENSOR_PL2,         pl2),
+	SAMPLED_REG(QC71_SENSOR_PL4,         pl4),
+};
+static_assert(ARRAY_SIZE(qc71_sampled_regs) == QC71_SAMPLE_EC_READS);
+
+/* ========================================================================== */
+
+static int qc71_sampler_take(struct qc71_sample *s)
+{
+	size_t i;
+	int err;
+
+	for (i = 0; i < ARRAY_SIZE(qc71_sampled_regs); i++) {
+		const struct qc71_sampled_reg *reg = &qc71_sampled_regs[i];
+		void *field = (u8 *) s + reg->offset;
+
+		/* always a new EC read, but it also refreshes the cached values for other readers */
+		err = qc71_sensor_read(reg->sensor, 0);
+		if (err < 0)
+			return err;
+
+		if (reg->size == sizeof(uint16_t))
+			*(uint16_t *) field = err;
+		else
+			*(uint8_t *) field = err;
+	}
+
+	/* must be read after FAN_CTRL_ADDR, see qc71_fan_write_ctrl() */
+	s->fan_ctrl_writes = qc71_fan_ctrl_write_count();
+	s->timestamp = ktime_get_ns();
+
+	return 0;
+}
+
+static void qc71_sampler_schedule(unsigned long delay)
+{
+	mod_delayed_work(system_wq, &sampler_work, delay);
+}
+
+static void qc71_sampler_work_fn(struct work_struct *work)
+{
+	unsigned int interval_ms = READ_ONCE(sample_interval_ms) ?: qc71_calibration.sample_interval_ms;
+	struct qc71_sampler_consumer *consumer;
+	struct qc71_sample sample;
+	int err;
+
+	mutex_lock(&sampler_lock);
+
+	if (list_empty(&sampler_consumers))
+		goto out;
+
+	err = qc71_sampler_take(&sample);
+	if (err) {
+		pr_debug("failed to take sample: %d\n", err);
+	} else {
+		list_for_each_entry (consumer, &sampler_consumers, node)
+			consumer->sample(consumer, &sample);
+	}
+
+	qc71_sampler_schedule(msecs_to_jiffies(interval_ms));
+
+out:
+	mutex_unlock(&sampler_lock);
+}
+
+/* ========================================================================== */
+
+void qc71_sampler_register(struct qc71_sampler_consumer *consumer)
+{
+	mutex_lock(&sampler_lock);
+
+	if (list_empty(&sampler_consumers))
+		qc71_sampler_schedule(0);
+
+	list_add_tail(&consumer->node, &sampler_consumers);
+
+	mutex_unlock(&sampler_lock);
+}
+
+void qc71_sampler_unregister(struct qc71_sampler_consumer *consumer)
+{
+	mutex_lock(&sampler_lock);
+
+	list_del_init(&consumer->node);
+
+	if (list_empty(&sampler_consumers))
+		cancel_delayed_work(&sampler_work);
+
+	mutex_unlock(&sampler_lock);
+}
+
+/* ========================================================================== */
+
+int __init qc71_sampler_setup(void)
+{
+	return 0;
+}
+
+void qc71_sampler_cleanup(void)
+{
+	cancel_delayed_work_sync(&sampler_work);
+}
@@ -0,0 +1,51 @@
+// SPDX-License-Identifier: GPL-2.0
+#ifndef QC71_SAMPLER_H
+#define QC71_SAMPLER_H
+
+#include <linux/init.h>
+#include <linux/list.h>
+#include <linux/types.h>
+
+/* ========================================================================== */
+
+/* number of EC reads needed to take a sample, checked against the table in sampler.c */
+#define QC71_SAMPLE_EC_READS 13
+
+/* raw register values, PWM is in the [0, FAN_MAX_PWM] range of the EC */
+struct qc71_sample {
+	u64 timestamp; /* ktime_get_ns() */
+
+	uint16_t rpm[2];
+	uint8_t  pwm[2];
+	uint8_t  temp[2];
+
+	uint8_t ctrl_1;
+	uint8_t ctrl_2;
+	uint8_t fan_ctrl;
+	uint8_t bios_ctrl_3;
+	uint8_t pl1, pl2, pl4;
+
+	/* number of FAN_CTRL_ADDR writes made by the driver so far */
+	unsigned int fan_ctrl_writes;
+};
+
+struct qc71_sampler_consumer {
+	struct list_head node;
+	void (*sample)(struct qc71_sampler_consumer *consumer,
+		       const struct qc71_sample *sample);
+};
+
+/* ========================================================================== */
+
+/*
+ * sampling only takes place while there is at least one registered consumer,
+ * the callbacks are called from process context, and they must not
+ * (un)register consumers
+ */
+void qc71_sampler_register(struct qc71_sampler_consumer *consumer);
+void qc71_sampler_unregister(struct qc71_sampler_consumer *consumer);
+
+int  __init qc71_sampler_setup(void);
+void        qc71_sampler_cleanup(void);
+
+#endif /* QC71_SAMPLER_H */
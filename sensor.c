@@ -0,0 +1,252 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "pr.h"
+
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/lockdep.h>
+#include <linux/moduleparam.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/types.h>
+
+#include "calibration.h"
+#include "ec.h"
+#include "sensor.h"
+
+/* ========================================================================== */
+
+static int sensor_max_age_ms = -1;
+module_param(sensor_max_age_ms, int, 0644);
+MODULE_PARM_DESC(sensor_max_age_ms, "maximum age of a cached sensor value returned to hwmon and similar readers in milliseconds, 0 disables caching, -1 derives it from the measured EC latency (default=-1)");
+
+/* ========================================================================== */
+
+struct qc71_sensor {
+	uint16_t addr;
+	bool word; /* two bytes, most significant first, like the fan speeds */
+
+	/* held while the value is read from the EC, so that it is only read once */
+	struct mutex refresh_lock;
+
+	/* protected by 'sensor_lock' */
+	bool valid;
+	int value;
+	u64 timestamp; /* when the EC read was started */
+	unsigned int generation; /* incremented when the register is written */
+	u64 hits;
+	u64 refreshes;
+};
+
+#define SENSOR(_id, _addr, _word) \
+	[_id] = { \
+		.addr = (_addr), \
+		.word = (_word), \
+		.refresh_lock = __MUTEX_INITIALIZER(qc71_sensors[_id].refresh_lock), \
+	}
+
+static DEFINE_SPINLOCK(sensor_lock);
+
+static struct qc71_sensor qc71_sensors[QC71_SENSOR_COUNT] = {
+	SENSOR(QC71_SENSOR_FAN1_RPM,      FAN_RPM_1_ADDR,     true),
+	SENSOR(QC71_SENSOR_FAN2_RPM,      FAN_RPM_2_ADDR,     true),
+	SENSOR(QC71_SENSOR_FAN1_PWM,      FAN_PWM_1_ADDR,     false),
+	SENSOR(QC71_SENSOR_FAN2_PWM,      FAN_PWM_2_ADDR,     false),
+	SENSOR(QC71_SENSOR_FAN1_TEMP,     FAN_TEMP_1_ADDR,    false),
+	SENSOR(QC71_SENSOR_FAN2_TEMP,     FAN_TEMP_2_ADDR,    false),
+	SENSOR(QC71_SENSOR_CTRL_1,        CTRL_1_ADDR,        false),
+	SENSOR(QC71_SENSOR_CTRL_2,        CTRL_2_ADDR,        false),
+	SENSOR(QC71_SENSOR_FAN_CTRL,      FAN_CTRL_ADDR,      false),
+	SENSOR(QC71_SENSOR_BIOS_CTRL_1,   BIOS_CTRL_1_ADDR,   false),
+	SENSOR(QC71_SENSOR_BIOS_CTRL_3,   BIOS_CTRL_3_ADDR,   false),
+	SENSOR(QC71_SENSOR_PL1,           PL1_ADDR,           false),
+	SENSOR(QC71_SENSOR_PL2,           PL2_ADDR,           false),
+	SENSOR(QC71_SENSOR_PL4,           PL4_ADDR,           false),
+	SENSOR(QC71_SENSOR_LIGHTBAR_CTRL, LIGHTBAR_CTRL_ADDR, false),
+};
+
+/* ========================================================================== */
+
+/*
+ * a value is also accepted if its EC read was started after the caller
+ * asked for it, this is what lets callers waiting for an ongoing read
+ * use its result even with 'max_age_ns' == 0
+ */
+static bool qc71_sensor_is_fresh(const struct qc71_sensor *s, u64 start, u64 max_age_ns)
+{
+	lockdep_assert_held(&sensor_lock);
+
+	if (!s->valid)
+		return false;
+
+	return s->timestamp >= start || start - s->timestamp <= max_age_ns;
+}
+
+static int qc71_sensor_fetch(const struct qc71_sensor *s)
+{
+	union qc71_ec_result res;
+	int err = qc71_ec_read(s->addr, &res);
+
+	if (err)
+		return err;
+
+	if (s->word)
+		return res.bytes.b1 << 8 | res.bytes.b2;
+
+	return res.bytes.b1;
+}
+
+/* ========================================================================== */
+
+int qc71_sensor_read(enum qc71_sensor_id id, unsigned int max_age_ms)
+{
+	u64 start, timestamp, max_age_ns = (u64) max_age_ms * NSEC_PER_MSEC;
+	unsigned int generation;
+	struct qc71_sensor *s;
+	int err;
+
+	if (id >= QC71_SENSOR_COUNT)
+		return -EINVAL;
+
+	s = &qc71_sensors[id];
+	start = ktime_get_ns();
+
+	spin_lock(&sensor_lock);
+	if (qc71_sensor_is_fresh(s, start, max_age_ns)) {
+		s->hits += 1;
+		err = s->value;
+		spin_unlock(&sensor_lock);
+		return err;
+	}
+	spin_unlock(&sensor_lock);
+
+	err = mutex_lock_interruptible(&s->refresh_lock);
+	if (err)
+		return err;
+
+	/* it might have been refreshed while waiting for the lock */
+	spin_lock(&sensor_lock);
+	if (qc71_sensor_is_fresh(s, start, max_age_ns)) {
+		s->hits += 1;
+		err = s->value;
+		spin_unlock(&sensor_lock);
+		goto out;
+	}
+	generation = s->generation;
+	spin_unlock(&sensor_lock);
+
+	timestamp = ktime_get_ns();
+	err = qc71_sensor_fetch(s);
+
+	spin_lock(&sensor_lock);
+	if (err >= 0) {
+		s->refreshes += 1;
+
+		/* a write might have overlapped with the read, do not cache its result */
+		if (s->generation == generation) {
+			s->value = err;
+			s->timestamp = timestamp;
+			s->valid = true;
+		}
+	}
+	spin_unlock(&sensor_lock);
+
+out:
+	mutex_unlock(&s->refresh_lock);
+	return err;
+}
+
+int qc71_sensor_write(enum qc71_sensor_id id, uint8_t value)
+{
+	unsigned int generation;
+	struct qc71_sensor *s;
+	int err;
+
+	if (id >= QC71_SENSOR_COUNT || qc71_sensors[id].word)
+		return -EINVAL;
+
+	s = &qc71_sensors[id];
+
+	err = mutex_lock_interruptible(&s->refresh_lock);
+	if (err)
+		return err;
+
+	spin_lock(&sensor_lock);
+	generation = s->generation;
+	spin_unlock(&sensor_lock);
+
+	err = ec_write_byte(s->addr, value);
+
+	spin_lock(&sensor_lock);
+	/* the write itself invalidates the sensor once, anything more is someone else */
+	if (!err && s->generation == generation + 1) {
+		s->value = value;
+		s->timestamp = ktime_get_ns();
+		s->valid = true;
+	}
+	spin_unlock(&sensor_lock);
+
+	mutex_unlock(&s->refresh_lock);
+	return err;
+}
+
+void qc71_sensor_invalidate(enum qc71_sensor_id id)
+{
+	if (id >= QC71_SENSOR_COUNT)
+		return;
+
+	spin_lock(&sensor_lock);
+	qc71_sensors[id].valid = false;
+	qc71_sensors[id].generation += 1;
+	spin_unlock(&sensor_lock);
+}
+
+void qc71_sensor_invalidate_addr(uint16_t addr)
+{
+	size_t i;
+
+	spin_lock(&sensor_lock);
+
+	for (i = 0; i < ARRAY_SIZE(qc71_sensors); i++) {
+		struct qc71_sensor *s = &qc71_sensors[i];
+
+		/* a word sensor spans two registers */
+		if (s->addr == addr || (s->word && s->addr + 1 == addr)) {
+			s->valid = false;
+			s->generation += 1;
+		}
+	}
+
+	spin_unlock(&sensor_lock);
+}
+
+unsigned int qc71_sensor_default_max_age(void)
+{
+	int max_age_ms = READ_ONCE(sensor_max_age_ms);
+
+	if (max_age_ms < 0)
+		return qc71_calibration.sensor_max_age_ms;
+
+	return max_age_ms;
+}
+
+int qc71_sensor_get_info(enum qc71_sensor_id id, struct qc71_sensor_info *info)
+{
+	const struct qc71_sensor *s;
+	u64 now = ktime_get_ns();
+
+	if (id >= QC71_SENSOR_COUNT)
+		return -EINVAL;
+
+	s = &qc71_sensors[id];
+
+	spin_lock(&sensor_lock);
+	info->addr      = s->addr;
+	info->valid     = s->valid;
+	info->value     = s->value;
+	info->age_ns    = now > s->timestamp ? now - s->timestamp : 0;
+	info->hits      = s->hits;
+	info->refreshes = s->refreshes;
+	spin_unlock(&sensor_lock);
+
+	return 0;
+}
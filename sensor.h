@@ -0,0 +1,59 @@
+// SPDX-License-Identifier: GPL-2.0
+#ifndef QC71_SENSOR_H
+#define QC71_SENSOR_H
+
+#include <linux/types.h>
+
+/* ========================================================================== */
+
+enum qc71_sensor_id {
+	QC71_SENSOR_FAN1_RPM,
+	QC71_SENSOR_FAN2_RPM,
+	QC71_SENSOR_FAN1_PWM, /* raw, 0 - FAN_MAX_PWM */
+	QC71_SENSOR_FAN2_PWM,
+	QC71_SENSOR_FAN1_TEMP,
+	QC71_SENSOR_FAN2_TEMP,
+	QC71_SENSOR_CTRL_1,
+	QC71_SENSOR_CTRL_2,
+	QC71_SENSOR_FAN_CTRL,
+	QC71_SENSOR_BIOS_CTRL_1,
+	QC71_SENSOR_BIOS_CTRL_3,
+	QC71_SENSOR_PL1,
+	QC71_SENSOR_PL2,
+	QC71_SENSOR_PL4,
+	QC71_SENSOR_LIGHTBAR_CTRL,
+	QC71_SENSOR_COUNT,
+};
+
+struct qc71_sensor_info {
+	uint16_t addr;
+	bool valid;
+	int value;
+	u64 age_ns;
+	u64 hits;
+	u64 refreshes;
+};
+
+/* ========================================================================== */
+
+/*
+ * returns the value of the sensor if it was read at most 'max_age_ms'
+ * milliseconds ago, otherwise it is read from the EC, 0 forces a new read;
+ * concurrent callers share a single EC transaction
+ */
+int qc71_sensor_read(enum qc71_sensor_id id, unsigned int max_age_ms);
+
+/* writes the register and caches the written value */
+int qc71_sensor_write(enum qc71_sensor_id id, uint8_t value);
+
+void qc71_sensor_invalidate(enum qc71_sensor_id id);
+
+/* called for every EC write */
+void qc71_sensor_invalidate_addr(uint16_t addr);
+
+/* the staleness accepted by callers without stricter requirements, e.g. hwmon */
+unsigned int qc71_sensor_default_max_age(void);
+
+int qc71_sensor_get_info(enum qc71_sensor_id id, struct qc71_sensor_info *info);
+
+#endif /* QC71_SENSOR_H */
@@ -0,0 +1,308 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "pr.h"
+
+#include <linux/debugfs.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/log2.h>
+#include <linux/moduleparam.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+#include <linux/types.h>
+
+#include "debugfs.h"
+#include "fan.h"
+#include "sampler.h"
+#include "sketch.h"
+
+/* ========================================================================== */
+/*
+ * fixed-memory quantile sketches of the sampled values: every value falls into
+ * a logarithmically sized bucket (values below 2^SKETCH_SUB_BITS have their
+ * own buckets, above that every power of two is split into 2^SKETCH_SUB_BITS
+ * buckets), so the relative error of any quantile is at most 2^-(SKETCH_SUB_BITS + 1).
+ * Since the bucket boundaries are the same everywhere, sketches from different
+ * machines can be merged by adding up the bucket counts.
+ *
+ * Serialized format, one line per channel:
+ *   <name> <version> <sub bits> <count> <min> <max> [<bucket>:<count> ...]
+ * where only the non-empty buckets are listed.
+ */
+
+#define SKETCH_VERSION  1
+#define SKETCH_SUB_BITS 5
+#define SKETCH_SUB_COUNT (1U << SKETCH_SUB_BITS)
+#define SKETCH_MAX_VALUE U16_MAX
+#define SKETCH_BUCKETS \
+	(SKETCH_SUB_COUNT + (ilog2(SKETCH_MAX_VALUE) - SKETCH_SUB_BITS + 1) * SKETCH_SUB_COUNT)
+
+enum qc71_sketch_channel {
+	SKETCH_FAN1_RPM,
+	SKETCH_FAN2_RPM,
+	SKETCH_FAN1_PWM,
+	SKETCH_FAN2_PWM,
+	SKETCH_FAN1_TEMP,
+	SKETCH_FAN2_TEMP,
+	SKETCH_CHANNEL_COUNT
+};
+
+static const char * const sketch_channel_names[SKETCH_CHANNEL_COUNT] = {
+	[SKETCH_FAN1_RPM]  = "fan1_rpm",
+	[SKETCH_FAN2_RPM]  = "fan2_rpm",
+	[SKETCH_FAN1_PWM]  = "fan1_pwm",
+	[SKETCH_FAN2_PWM]  = "fan2_pwm",
+	[SKETCH_FAN1_TEMP] = "fan1_temp",
+	[SKETCH_FAN2_TEMP] = "fan2_temp",
+};
+
+struct qc71_sketch {
+	u64 count;
+	unsigned int min, max;
+	u32 buckets[SKETCH_BUCKETS];
+};
+
+/* ========================================================================== */
+
+static bool sketches;
+module_param(sketches, bool, 0444);
+MODULE_PARM_DESC(sketches, "collect quantile sketches of the fan speeds, PWM values and temperatures (default=false)");
+
+/* ========================================================================== */
+
+static DEFINE_SPINLOCK(sketch_lock);
+static struct qc71_sketch sketch_data[SKETCH_CHANNEL_COUNT];
+static bool sketch_consumer_registered;
+static struct dentry *sketch_dir;
+
+/* ========================================================================== */
+
+static unsigned int qc71_sketch_bucket(unsigned int value)
+{
+	unsigned int e;
+
+	if (value < SKETCH_SUB_COUNT)
+		return value;
+
+	e = ilog2(value);
+
+	return SKETCH_SUB_COUNT + (e - SKETCH_SUB_BITS) * SKETCH_SUB_COUNT +
+	       ((value >> (e - SKETCH_SUB_BITS)) - SKETCH_SUB_COUNT);
+}
+
+/* the midpoint of the bucket */
+static unsigned int qc71_sketch_bucket_value(unsigned int bucket)
+{
+	unsigned int e, lower;
+
+	if (bucket < SKETCH_SUB_COUNT)
+		return bucket;
+
+	e = (bucket - SKETCH_SUB_COUNT) / SKETCH_SUB_COUNT + SKETCH_SUB_BITS;
+	lower = (SKETCH_SUB_COUNT + (bucket - SKETCH_SUB_COUNT) % SKETCH_SUB_COUNT) << (e - SKETCH_SUB_BITS);
+
+	return lower + ((1U << (e - SKETCH_SUB_BITS)) - 1) / 2;
+}
+
+static void qc71_sketch_add(struct qc71_sketch *sk, unsigned int value)
+{
+	value = min_t(unsigned int, value, SKETCH_MAX_VALUE);
+
+	if (sk->count == 0 || value < sk->min)
+		sk->min = value;
+	if (sk->count == 0 || value > sk->max)
+		sk->max = value;
+
+	sk->count += 1;
+	sk->buckets[qc71_sketch_bucket(value)] += 1;
+}
+
+static unsigned int qc71_sketch_quantile(const struct qc71_sketch *sk, unsigned int percent)
+{
+	u64 rank = max_t(u64, 1, DIV_ROUND_UP_ULL(sk->count * percent, 100)), seen = 0;
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(sk->buckets); i++) {
+		seen += sk->buckets[i];
+
+		if (seen >= rank)
+			return clamp(qc71_sketch_bucket_value(i), sk->min, sk->max);
+	}
+
+	return sk->max;
+}
+
+static void qc71_sketch_sample(struct qc71_sampler_consumer *consumer,
+			       const struct qc71_sample *s)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&sketch_lock, flags);
+
+	qc71_sketch_add(&sketch_data[SKETCH_FAN1_RPM],  s->rpm[0]);
+	qc71_sketch_add(&sketch_data[SKETCH_FAN2_RPM],  s->rpm[1]);
+	qc71_sketch_add(&sketch_data[SKETCH_FAN1_PWM],  s->pwm[0] * U8_MAX / FAN_MAX_PWM);
+	qc71_sketch_add(&sketch_data[SKETCH_FAN2_PWM],  s->pwm[1] * U8_MAX / FAN_MAX_PWM);
+	qc71_sketch_add(&sketch_data[SKETCH_FAN1_TEMP], s->temp[0]);
+	qc71_sketch_add(&sketch_data[SKETCH_FAN2_TEMP], s->temp[1]);
+
+	spin_unlock_irqrestore(&sketch_lock, flags);
+}
+
+static struct qc71_sampler_consumer sketch_consumer = {
+	.sample = qc71_sketch_sample,
+};
+
+/* ========================================================================== */
+
+/* a copy is made so that the lock is not held while printing */
+static void qc71_sketch_copy(struct qc71_sketch *dst, enum qc71_sketch_channel channel)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&sketch_lock, flags);
+	memcpy(dst, &sketch_data[channel], sizeof(*dst));
+	spin_unlock_irqrestore(&sketch_lock, flags);
+}
+
+static int qc71_sketch_serialized_show(struct seq_file *m, void *unused)
+{
+	struct qc71_sketch *sk = m->private;
+	unsigned int i, channel;
+
+	for (channel = 0; channel < SKETCH_CHANNEL_COUNT; channel++) {
+		qc71_sketch_copy(sk, channel);
+
+		seq_printf(m, "%s %u %u %llu %u %u", sketch_channel_names[channel],
+			   SKETCH_VERSION, SKETCH_SUB_BITS, sk->count, sk->min, sk->max);
+
+		for (i = 0; i < ARRAY_SIZE(sk->buckets); i++)
+			if (sk->buckets[i])
+				seq_printf(m, " %u:%u", i, sk->buckets[i]);
+
+		seq_putc(m, '\n');
+	}
+
+	return 0;
+}
+
+static int qc71_sketch_quantiles_show(struct seq_file *m, void *unused)
+{
+	struct qc71_sketch *sk = m->private;
+	unsigned int channel;
+
+	seq_puts(m, "# channel count min p50 p90 p99 max\n");
+
+	for (channel = 0; channel < SKETCH_CHANNEL_COUNT; channel++) {
+		qc71_sketch_copy(sk, channel);
+
+		if (sk->count == 0) {
+			seq_printf(m, "%s 0\n", sketch_channel_names[channel]);
+			continue;
+		}
+
+		seq_printf(m, "%s %llu %u %u %u %u %u\n", sketch_channel_names[channel],
+			   sk->count, sk->min,
+			   qc71_sketch_quantile(sk, 50),
+			   qc71_sketch_quantile(sk, 90),
+			   qc71_sketch_quantile(sk, 99),
+			   sk->max);
+	}
+
+	return 0;
+}
+
+static int qc71_sketch_open(struct inode *inode, struct file *f,
+			    int (*show)(struct seq_file *, void *))
+{
+	struct qc71_sketch *sk = kzalloc(sizeof(*sk), GFP_KERNEL);
+	int err;
+
+	if (!sk)
+		return -ENOMEM;
+
+	err = single_open(f, show, sk);
+	if (err)
+		kfree(sk);
+
+	return err;
+}
+
+static int qc71_sketch_serialized_open(struct inode *inode, struct file *f)
+{
+	return qc71_sketch_open(inode, f, qc71_sketch_serialized_show);
+}
+
+static int qc71_sketch_quantiles_open(struct inode *inode, struct file *f)
+{
+	return qc71_sketch_open(inode, f, qc71_sketch_quantiles_show);
+}
+
+static int qc71_sketch_release(struct inode *inode, struct file *f)
+{
+	kfree(((struct seq_file *) f->private_data)->private);
+
+	return single_release(inode, f);
+}
+
+/* writing anything resets the sketches */
+static ssize_t qc71_sketch_write(struct file *f, const char __user *buf,
+				 size_t count, loff_t *offset)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&sketch_lock, flags);
+	memset(sketch_data, 0, sizeof(sketch_data));
+	spin_unlock_irqrestore(&sketch_lock, flags);
+
+	return count;
+}
+
+static const struct file_operations qc71_sketch_serialized_fops = {
+	.owner = THIS_MODULE,
+	.open = qc71_sketch_serialized_open,
+	.read = seq_read,
+	.write = qc71_sketch_write,
+	.llseek = seq_lseek,
+	.release = qc71_sketch_release,
+};
+
+static const struct file_operations qc71_sketch_quantiles_fops = {
+	.owner = THIS_MODULE,
+	.open = qc71_sketch_quantiles_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = qc71_sketch_release,
+};
+
+/* ========================================================================== */
+
+int __init qc71_sketch_setup(void)
+{
+	if (!sketches || IS_ERR_OR_NULL(qc71_debugfs_dir))
+		return -ENODEV;
+
+	sketch_dir = debugfs_create_dir("sketches", qc71_debugfs_dir);
+	if (IS_ERR(sketch_dir))
+		return PTR_ERR(sketch_dir);
+
+	debugfs_create_file("serialized", 0600, sketch_dir, NULL, &qc71_sketch_serialized_fops);
+	debugfs_create_file("quantiles", 0400, sketch_dir, NULL, &qc71_sketch_quantiles_fops);
+
+	qc71_sampler_register(&sketch_consumer);
+	sketch_consumer_registered = true;
+
+	return 0;
+}
+
+void qc71_sketch_cleanup(void)
+{
+	if (sketch_consumer_registered) {
+		qc71_sampler_unregister(&sketch_consumer);
+		sketch_consumer_registered = false;
+	}
+
+	/* checks if IS_ERR_OR_NULL() */
+	debugfs_remove_recursive(sketch_dir);
+}
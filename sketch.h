@@ -0,0 +1,26 @@
+// SPDX-License-Identifier: GPL-2.0
+#ifndef QC71_SKETCH_H
+#define QC71_SKETCH_H
+
+#if IS_ENABLED(CONFIG_DEBUG_FS)
+
+#include <linux/init.h>
+
+int  __init qc71_sketch_setup(void);
+void        qc71_sketch_cleanup(void);
+
+#else
+
+static inline int qc71_sketch_setup(void)
+{
+	return 0;
+}
+
+static inline void qc71_sketch_cleanup(void)
+{
+
+}
+
+#endif
+
+#endif /* QC71_SKETCH_H */
@@ -0,0 +1,299 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "pr.h"
+
+#include <linux/debugfs.h>
+#include <linux/init.h>
+#include <linux/io.h>
+#include <linux/ioport.h>
+#include <linux/ktime.h>
+#include <linux/moduleparam.h>
+#include <linux/seq_file.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+#include <linux/types.h>
+#include <linux/vmalloc.h>
+
+#include "debugfs.h"
+#include "sampler.h"
+#include "telemetry.h"
+
+/* ========================================================================== */
+/*
+ * the most recent samples and WMI events are mirrored into a ring buffer
+ * in a memory region that is reserved by the user (e.g. with the 'memmap='
+ * kernel parameter, the same way as for ramoops), so that they can be
+ * recovered after a crash or a thermal shutdown followed by a warm boot
+ */
+
+#define TELEMETRY_MAGIC   0x54313751 /* "Q71T" */
+#define TELEMETRY_VERSION 1
+
+enum qc71_telemetry_record_type {
+	TELEMETRY_RECORD_SAMPLE = 1,
+	TELEMETRY_RECORD_EVENT  = 2,
+};
+
+struct qc71_telemetry_record {
+	u64 seq; /* index of the record + 1, 0 means empty */
+	u64 timestamp; /* ktime_get_real_ns() */
+	u32 type;
+	union {
+		struct {
+			u16 rpm[2];
+			u8  pwm[2];
+			u8  temp[2];
+			u8  fan_ctrl;
+			u8  ctrl_1;
+		} sample;
+		struct {
+			u32 source;
+			u32 code;
+		} event;
+	};
+} __packed;
+
+struct qc71_telemetry_header {
+	u32 magic;
+	u32 version;
+	u32 record_size;
+	u32 capacity;
+	u64 head; /* number of records written */
+	struct qc71_telemetry_record records[];
+} __packed;
+
+/* ========================================================================== */
+
+static unsigned long telemetry_mem_address;
+module_param(telemetry_mem_address, ulong, 0444);
+MODULE_PARM_DESC(telemetry_mem_address, "physical address of the reserved memory region of the persistent telemetry ring (default=0)");
+
+static unsigned long telemetry_mem_size;
+module_param(telemetry_mem_size, ulong, 0444);
+MODULE_PARM_DESC(telemetry_mem_size, "size of the reserved memory region of the persistent telemetry ring, 0 disables it (default=0)");
+
+/* ========================================================================== */
+
+static DEFINE_SPINLOCK(telemetry_lock);
+
+static struct qc71_telemetry_header *telemetry_ring;
+static struct qc71_telemetry_header *telemetry_previous; /* recovered at load */
+static size_t telemetry_previous_size;
+static bool telemetry_mem_requested;
+static struct dentry *telemetry_dir;
+
+/* ========================================================================== */
+
+static void qc71_telemetry_append(struct qc71_telemetry_record *rec)
+{
+	struct qc71_telemetry_header *ring;
+	unsigned long flags;
+	u64 head;
+
+	if (!READ_ONCE(telemetry_ring))
+		return;
+
+	rec->timestamp = ktime_get_real_ns();
+
+	spin_lock_irqsave(&telemetry_lock, flags);
+
+	ring = telemetry_ring;
+	if (!ring)
+		goto out;
+
+	head = ring->head;
+	rec->seq = head + 1;
+	memcpy(&ring->records[head % ring->capacity], rec, sizeof(*rec));
+	WRITE_ONCE(ring->head, head + 1);
+
+out:
+	spin_unlock_irqrestore(&telemetry_lock, flags);
+}
+
+void qc71_telemetry_log_event(unsigned int source, u32 code)
+{
+	struct qc71_telemetry_record rec = {
+		.type = TELEMETRY_RECORD_EVENT,
+		.event = {
+			.source = source,
+			.code = code,
+		},
+	};
+
+	qc71_telemetry_append(&rec);
+}
+
+static void qc71_telemetry_sample(struct qc71_sampler_consumer *consumer,
+				  const struct qc71_sample *s)
+{
+	struct qc71_telemetry_record rec = {
+		.type = TELEMETRY_RECORD_SAMPLE,
+		.sample = {
+			.rpm      = { s->rpm[0], s->rpm[1] },
+			.pwm      = { s->pwm[0], s->pwm[1] },
+			.temp     = { s->temp[0], s->temp[1] },
+			.fan_ctrl = s->fan_ctrl,
+			.ctrl_1   = s->ctrl_1,
+		},
+	};
+
+	qc71_telemetry_append(&rec);
+}
+
+static struct qc71_sampler_consumer telemetry_consumer = {
+	.sample = qc71_telemetry_sample,
+};
+
+/* ========================================================================== */
+
+static void qc71_telemetry_show_ring(struct seq_file *m, const struct qc71_telemetry_header *ring)
+{
+	u64 i, head = READ_ONCE(ring->head);
+
+	seq_puts(m, "# seq time_ns sample rpm1 rpm2 pwm1 pwm2 temp1 temp2 fan_ctrl ctrl_1\n");
+	seq_puts(m, "# seq time_ns event source code\n");
+
+	for (i = head > ring->capacity ? head - ring->capacity : 0; i < head; i++) {
+		const struct qc71_telemetry_record *rec = &ring->records[i % ring->capacity];
+
+		/* overwritten while printing, or torn by a crash */
+		if (rec->seq != i + 1)
+			continue;
+
+		switch (rec->type) {
+		case TELEMETRY_RECORD_SAMPLE:
+			seq_printf(m, "%llu %llu sample %u %u %u %u %u %u %#04x %#04x\n",
+				   rec->seq, rec->timestamp,
+				   rec->sample.rpm[0], rec->sample.rpm[1],
+				   rec->sample.pwm[0], rec->sample.pwm[1],
+				   rec->sample.temp[0], rec->sample.temp[1],
+				   rec->sample.fan_ctrl, rec->sample.ctrl_1);
+			break;
+		case TELEMETRY_RECORD_EVENT:
+			seq_printf(m, "%llu %llu event %u %u\n",
+				   rec->seq, rec->timestamp,
+				   rec->event.source, rec->event.code);
+			break;
+		}
+	}
+}
+
+static int qc71_telemetry_current_show(struct seq_file *m, void *unused)
+{
+	qc71_telemetry_show_ring(m, telemetry_ring);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(qc71_telemetry_current);
+
+static int qc71_telemetry_previous_show(struct seq_file *m, void *unused)
+{
+	qc71_telemetry_show_ring(m, telemetry_previous);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(qc71_telemetry_previous);
+
+/* ========================================================================== */
+
+static bool __init qc71_telemetry_header_valid(const struct qc71_telemetry_header *h, size_t size)
+{
+	return h->magic == TELEMETRY_MAGIC &&
+	       h->version == TELEMETRY_VERSION &&
+	       h->record_size == sizeof(struct qc71_telemetry_record) &&
+	       h->capacity > 0 &&
+	       struct_size(h, records, h->capacity) <= size;
+}
+
+int __init qc71_telemetry_setup(void)
+{
+	struct qc71_telemetry_header *ring;
+	size_t capacity;
+	int err;
+
+	if (!telemetry_mem_address || !telemetry_mem_size)
+		return -ENODEV;
+
+	if (IS_ERR_OR_NULL(qc71_debugfs_dir))
+		return -ENODEV;
+
+	if (telemetry_mem_size < struct_size(ring, records, 1))
+		return -EINVAL;
+
+	if (request_mem_region(telemetry_mem_address, telemetry_mem_size, KBUILD_MODNAME " telemetry"))
+		telemetry_mem_requested = true;
+	else
+		pr_warn("cannot request memory region, continuing anyways\n");
+
+	/* write-through so that the records reach memory without explicit flushing */
+	ring = memremap(telemetry_mem_address, telemetry_mem_size, MEMREMAP_WT);
+	if (!ring) {
+		err = -ENOMEM;
+		goto out_release;
+	}
+
+	if (qc71_telemetry_header_valid(ring, telemetry_mem_size)) {
+		telemetry_previous_size = struct_size(ring, records, ring->capacity);
+		telemetry_previous = vmalloc(telemetry_previous_size);
+
+		if (telemetry_previous) {
+			memcpy(telemetry_previous, ring, telemetry_previous_size);
+			pr_info("recovered %llu telemetry records from the previous boot\n",
+				min_t(u64, ring->head, ring->capacity));
+		}
+	}
+
+	capacity = min_t(size_t, U32_MAX,
+			 (telemetry_mem_size - sizeof(*ring)) / sizeof(ring->records[0]));
+
+	memset(ring, 0, struct_size(ring, records, capacity));
+	ring->magic       = TELEMETRY_MAGIC;
+	ring->version     = TELEMETRY_VERSION;
+	ring->record_size = sizeof(ring->records[0]);
+	ring->capacity    = capacity;
+	ring->head        = 0;
+
+	telemetry_dir = debugfs_create_dir("telemetry", qc71_debugfs_dir);
+	debugfs_create_file("current", 0400, telemetry_dir, NULL, &qc71_telemetry_current_fops);
+	if (telemetry_previous)
+		debugfs_create_file("previous", 0400, telemetry_dir, NULL,
+				    &qc71_telemetry_previous_fops);
+
+	WRITE_ONCE(telemetry_ring, ring);
+	qc71_sampler_register(&telemetry_consumer);
+
+	return 0;
+
+out_release:
+	if (telemetry_mem_requested)
+		release_mem_region(telemetry_mem_address, telemetry_mem_size);
+
+	telemetry_mem_requested = false;
+
+	return err;
+}
+
+void qc71_telemetry_cleanup(void)
+{
+	struct qc71_telemetry_header *ring = telemetry_ring;
+	unsigned long flags;
+
+	if (!ring)
+		return;
+
+	qc71_sampler_unregister(&telemetry_consumer);
+
+	/* checks if IS_ERR_OR_NULL() */
+	debugfs_remove_recursive(telemetry_dir);
+
+	spin_lock_irqsave(&telemetry_lock, flags);
+	WRITE_ONCE(telemetry_ring, NULL);
+	spin_unlock_irqrestore(&telemetry_lock, flags);
+
+	memunmap(ring);
+
+	if (telemetry_mem_requested)
+		release_mem_region(telemetry_mem_address, telemetry_mem_size);
+
+	vfree(telemetry_previous);
+	telemetry_previous = NULL;
+}
@@ -0,0 +1,36 @@
+// SPDX-License-Identifier: GPL-2.0
+#ifndef QC71_TELEMETRY_H
+#define QC71_TELEMETRY_H
+
+#include <linux/types.h>
+
+#if IS_ENABLED(CONFIG_DEBUG_FS)
+
+#include <linux/init.h>
+
+/* 'source' is the index of the WMI event GUID */
+void qc71_telemetry_log_event(unsigned int source, u32 code);
+
+int  __init qc71_telemetry_setup(void);
+void        qc71_telemetry_cleanup(void);
+
+#else
+
+static inline void qc71_telemetry_log_event(unsigned int source, u32 code)
+{
+
+}
+
+static inline int qc71_telemetry_setup(void)
+{
+	return 0;
+}
+
+static inline void qc71_telemetry_cleanup(void)
+{
+
+}
+
+#endif
+
+#endif /* QC71_TELEMETRY_H */
@@ -0,0 +1,104 @@
+// SPDX-License-Identifier: GPL-2.0
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "qc71d.h"
+
+/* ========================================================================== */
+
+#define READ_RETRIES 1000
+
+struct qc71d_client {
+	const struct qc71d_shm *shm;
+	size_t size;
+};
+
+/* ========================================================================== */
+
+struct qc71d_client *qc71d_open(const char *name)
+{
+	struct qc71d_client *client;
+	struct stat st;
+	void *p;
+	int fd;
+
+	fd = shm_open(name ? name : QC71D_DEFAULT_SHM_NAME, O_RDONLY, 0);
+	if (fd < 0)
+		return NULL;
+
+	if (fstat(fd, &st) < 0)
+		goto err_close;
+
+	if ((size_t) st.st_size < sizeof(struct qc71d_shm)) {
+		errno = EPROTO;
+		goto err_close;
+	}
+
+	p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED)
+		goto err_close;
+
+	close(fd);
+
+	client = malloc(sizeof(*client));
+	if (!client) {
+		munmap(p, st.st_size);
+		return NULL;
+	}
+
+	client->shm = p;
+	client->size = st.st_size;
+
+	if (client->shm->magic != QC71D_MAGIC || client->shm->version != QC71D_VERSION) {
+		qc71d_close(client);
+		errno = EPROTO;
+		return NULL;
+	}
+
+	return client;
+
+err_close:
+	close(fd);
+	return NULL;
+}
+
+void qc71d_close(struct qc71d_client *client)
+{
+	if (!client)
+		return;
+
+	munmap((void *) client->shm, client->size);
+	free(client);
+}
+
+int qc71d_read(const struct qc71d_client *client, struct qc71d_snapshot *snapshot)
+{
+	const struct qc71d_shm *shm = client->shm;
+	unsigned int i;
+
+	for (i = 0; i < READ_RETRIES; i++) {
+		uint32_t begin, end;
+
+		begin = atomic_load_explicit(&((struct qc71d_shm *) shm)->seq, memory_order_acquire);
+		if (begin & 1)
+			continue;
+
+		memcpy(snapshot, (const void *) &shm->snapshot, sizeof(*snapshot));
+
+		atomic_thread_fence(memory_order_acquire);
+		end = atomic_load_explicit(&((struct qc71d_shm *) shm)->seq, memory_order_relaxed);
+
+		if (begin == end)
+			return 0;
+	}
+
+	/* the writer died in the middle of an update */
+	errno = EAGAIN;
+	return -1;
+}
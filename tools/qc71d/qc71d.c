@@ -0,0 +1,344 @@
+// SPDX-License-Identifier: GPL-2.0
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "qc71d.h"
+
+/* ========================================================================== */
+
+#define PDEV_DIR     "/sys/devices/platform/qc71_laptop/"
+#define LIGHTBAR_DIR "/sys/class/leds/qc71_laptop::lightbar/"
+#define BATTERY_DIR  "/sys/class/power_supply/BAT0/"
+#define HWMON_DIR    "/sys/class/hwmon/"
+
+#define HWMON_FAN_NAME "qc71_laptop.hwmon.fan"
+#define HWMON_PWM_NAME "qc71_laptop.hwmon.pwm"
+
+/* how often missing attributes are looked for again */
+#define REOPEN_INTERVAL_NS (10 * UINT64_C(1000000000))
+
+/* ========================================================================== */
+
+enum source {
+	SOURCE_HWMON_FAN,
+	SOURCE_HWMON_PWM,
+	SOURCE_PDEV,
+	SOURCE_LIGHTBAR,
+	SOURCE_BATTERY,
+};
+
+static const struct attr {
+	enum source source;
+	const char *name;
+} attrs[QC71D_FIELD_COUNT] = {
+	[QC71D_FAN1_RPM]                     = { SOURCE_HWMON_FAN, "fan1_input" },
+	[QC71D_FAN2_RPM]                     = { SOURCE_HWMON_FAN, "fan2_input" },
+	[QC71D_FAN1_TEMP]                    = { SOURCE_HWMON_FAN, "temp1_input" },
+	[QC71D_FAN2_TEMP]                    = { SOURCE_HWMON_FAN, "temp2_input" },
+	[QC71D_FAN1_PWM]                     = { SOURCE_HWMON_PWM, "pwm1" },
+	[QC71D_FAN2_PWM]                     = { SOURCE_HWMON_PWM, "pwm2" },
+	[QC71D_PWM_ENABLE]                   = { SOURCE_HWMON_PWM, "pwm1_enable" },
+	[QC71D_FAN_ALWAYS_ON]                = { SOURCE_PDEV,      "fan_always_on" },
+	[QC71D_FAN_REDUCED_DUTY_CYCLE]       = { SOURCE_PDEV,      "fan_reduced_duty_cycle" },
+	[QC71D_FN_LOCK]                      = { SOURCE_PDEV,      "fn_lock" },
+	[QC71D_FN_LOCK_SWITCH]               = { SOURCE_PDEV,      "fn_lock_switch" },
+	[QC71D_MANUAL_CONTROL]               = { SOURCE_PDEV,      "manual_control" },
+	[QC71D_SUPER_KEY_LOCK]               = { SOURCE_PDEV,      "super_key_lock" },
+	[QC71D_DETERMINISM_MODE]             = { SOURCE_PDEV,      "determinism_mode" },
+	[QC71D_LIGHTBAR_BRIGHTNESS]          = { SOURCE_LIGHTBAR,  "brightness" },
+	[QC71D_LIGHTBAR_BRIGHTNESS_S3]       = { SOURCE_LIGHTBAR,  "brightness_s3" },
+	[QC71D_LIGHTBAR_COLOR]               = { SOURCE_LIGHTBAR,  "color" },
+	[QC71D_LIGHTBAR_RAINBOW_MODE]        = { SOURCE_LIGHTBAR,  "rainbow_mode" },
+	[QC71D_BATTERY_CHARGE_END_THRESHOLD] = { SOURCE_BATTERY,   "charge_control_end_threshold" },
+};
+
+/* ========================================================================== */
+
+static volatile sig_atomic_t stop;
+static int attr_fds[QC71D_FIELD_COUNT];
+
+/* set when a failure has been logged, cleared by the next successful read */
+static bool attr_failed[QC71D_FIELD_COUNT];
+
+/* ========================================================================== */
+
+static void handle_signal(int sig)
+{
+	(void) sig;
+	stop = 1;
+}
+
+static uint64_t monotonic_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static int find_hwmon_dir(const char *name, char *path, size_t size)
+{
+	struct dirent *e;
+	int found = 0;
+	DIR *d;
+
+	d = opendir(HWMON_DIR);
+	if (!d)
+		return 0;
+
+	while (!found && (e = readdir(d))) {
+		char buf[64] = { 0 };
+		FILE *f;
+
+		if (e->d_name[0] == '.')
+			continue;
+
+		snprintf(path, size, HWMON_DIR "%.32s/name", e->d_name);
+
+		f = fopen(path, "r");
+		if (!f)
+			continue;
+
+		if (fgets(buf, sizeof(buf), f)) {
+			buf[strcspn(buf, "\n")] = '\0';
+
+			if (strcmp(buf, name) == 0) {
+				snprintf(path, size, HWMON_DIR "%.32s/", e->d_name);
+				found = 1;
+			}
+		}
+
+		fclose(f);
+	}
+
+	closedir(d);
+	return found;
+}
+
+/*
+ * the attributes are kept open, and reread from offset 0 every time,
+ * they are reopened when the devices might have been registered again
+ */
+static void open_attrs(void)
+{
+	char dirs[5][256] = {
+		[SOURCE_PDEV]     = PDEV_DIR,
+		[SOURCE_LIGHTBAR] = LIGHTBAR_DIR,
+		[SOURCE_BATTERY]  = BATTERY_DIR,
+	};
+	int i;
+
+	if (!find_hwmon_dir(HWMON_FAN_NAME, dirs[SOURCE_HWMON_FAN], sizeof(dirs[0])))
+		dirs[SOURCE_HWMON_FAN][0] = '\0';
+
+	if (!find_hwmon_dir(HWMON_PWM_NAME, dirs[SOURCE_HWMON_PWM], sizeof(dirs[0])))
+		dirs[SOURCE_HWMON_PWM][0] = '\0';
+
+	for (i = 0; i < QC71D_FIELD_COUNT; i++) {
+		char path[320];
+
+		if (attr_fds[i] >= 0)
+			close(attr_fds[i]);
+
+		attr_fds[i] = -1;
+
+		if (!dirs[attrs[i].source][0])
+			continue;
+
+		snprintf(path, sizeof(path), "%s%s", dirs[attrs[i].source], attrs[i].name);
+		attr_fds[i] = open(path, O_RDONLY | O_CLOEXEC);
+	}
+}
+
+/* returns 0 or a negative errno */
+static int read_attr(int fd, int32_t *value)
+{
+	char buf[32];
+	ssize_t n;
+	char *end;
+	long v;
+
+	if (fd < 0)
+		return -ENOENT;
+
+	n = pread(fd, buf, sizeof(buf) - 1, 0);
+	if (n < 0)
+		return -errno;
+	if (n == 0)
+		return -ENODATA;
+
+	buf[n] = '\0';
+
+	errno = 0;
+	v = strtol(buf, &end, 10);
+	if (errno || end == buf)
+		return -EINVAL;
+
+	*value = v;
+
+	return 0;
+}
+
+/* returns true if an attribute is gone, or has never been found */
+static bool take_snapshot(struct qc71d_snapshot *s)
+{
+	bool missing = false;
+	int i, err;
+
+	s->valid = 0;
+
+	for (i = 0; i < QC71D_FIELD_COUNT; i++) {
+		err = read_attr(attr_fds[i], &s->values[i]);
+		if (err == 0) {
+			s->valid |= UINT64_C(1) << i;
+			attr_failed[i] = false;
+			continue;
+		}
+
+		s->values[i] = 0;
+
+		if (err == -ENODEV || err == -ENOENT)
+			missing = true;
+
+		if (!attr_failed[i]) {
+			fprintf(stderr, "qc71d: cannot read %s: %s\n", attrs[i].name, strerror(-err));
+			attr_failed[i] = true;
+		}
+	}
+
+	s->timestamp_ns = monotonic_ns();
+
+	return missing;
+}
+
+static void publish(struct qc71d_shm *shm, const struct qc71d_snapshot *s)
+{
+	uint32_t seq = atomic_load_explicit(&shm->seq, memory_order_relaxed);
+
+	atomic_store_explicit(&shm->seq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	memcpy(&shm->snapshot, s, sizeof(*s));
+
+	atomic_store_explicit(&shm->seq, seq + 2, memory_order_release);
+}
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr,
+		"usage: %s [-i interval_ms] [-n shm_name]\n"
+		"  -i  polling interval in milliseconds (default: 1000)\n"
+		"  -n  name of the shared memory object (default: " QC71D_DEFAULT_SHM_NAME ")\n",
+		argv0);
+}
+
+int main(int argc, char **argv)
+{
+	const char *name = QC71D_DEFAULT_SHM_NAME;
+	unsigned long interval_ms = 1000;
+	struct sigaction sa = { .sa_handler = handle_signal };
+	struct qc71d_snapshot snapshot;
+	struct qc71d_shm *shm;
+	uint64_t last_open_ns;
+	bool missing;
+	int i, opt, fd;
+
+	while ((opt = getopt(argc, argv, "i:n:h")) != -1) {
+		switch (opt) {
+		case 'i':
+			interval_ms = strtoul(optarg, NULL, 10);
+			if (interval_ms == 0) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'n':
+			name = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+	if (fd < 0) {
+		perror("shm_open");
+		return 1;
+	}
+
+	if (ftruncate(fd, sizeof(*shm)) < 0) {
+		perror("ftruncate");
+		goto err_unlink;
+	}
+
+	shm = mmap(NULL, sizeof(*shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (shm == MAP_FAILED) {
+		perror("mmap");
+		goto err_unlink;
+	}
+
+	close(fd);
+
+	for (i = 0; i < QC71D_FIELD_COUNT; i++)
+		attr_fds[i] = -1;
+
+	open_attrs();
+	last_open_ns = monotonic_ns();
+
+	/* an odd sequence number keeps readers away until the first snapshot */
+	atomic_store_explicit(&shm->seq, 1, memory_order_relaxed);
+	shm->size = sizeof(*shm);
+	shm->interval_ms = interval_ms;
+	shm->version = QC71D_VERSION;
+	atomic_thread_fence(memory_order_release);
+	shm->magic = QC71D_MAGIC;
+
+	missing = take_snapshot(&snapshot);
+	memcpy(&shm->snapshot, &snapshot, sizeof(snapshot));
+	atomic_store_explicit(&shm->seq, 2, memory_order_release);
+
+	while (!stop) {
+		struct timespec ts = {
+			.tv_sec  = interval_ms / 1000,
+			.tv_nsec = (interval_ms % 1000) * 1000000,
+		};
+
+		nanosleep(&ts, NULL);
+
+		if (stop)
+			break;
+
+		/* e.g. the module has been reloaded, and the hwmon devices have been renumbered */
+		if (missing && monotonic_ns() - last_open_ns >= REOPEN_INTERVAL_NS) {
+			open_attrs();
+			last_open_ns = monotonic_ns();
+		}
+
+		missing = take_snapshot(&snapshot);
+		publish(shm, &snapshot);
+	}
+
+	shm_unlink(name);
+	return 0;
+
+err_unlink:
+	close(fd);
+	shm_unlink(name);
+	return 1;
+}
@@ -0,0 +1,77 @@
+// SPDX-License-Identifier: GPL-2.0
+#ifndef QC71D_H
+#define QC71D_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/* ========================================================================== */
+/*
+ * qc71d reads the attributes of the qc71_laptop driver at a fixed rate and
+ * publishes them in a POSIX shared memory segment, protected by a sequence
+ * lock, so that any number of local readers can get the current state without
+ * system calls and without generating additional EC traffic
+ */
+
+#define QC71D_DEFAULT_SHM_NAME "/qc71d"
+#define QC71D_MAGIC   0x71d0c0deu
+#define QC71D_VERSION 1
+
+/* bits of 'qc71d_snapshot.valid' */
+enum qc71d_field {
+	QC71D_FAN1_RPM,
+	QC71D_FAN2_RPM,
+	QC71D_FAN1_TEMP,
+	QC71D_FAN2_TEMP,
+	QC71D_FAN1_PWM,
+	QC71D_FAN2_PWM,
+	QC71D_PWM_ENABLE,
+	QC71D_FAN_ALWAYS_ON,
+	QC71D_FAN_REDUCED_DUTY_CYCLE,
+	QC71D_FN_LOCK,
+	QC71D_FN_LOCK_SWITCH,
+	QC71D_MANUAL_CONTROL,
+	QC71D_SUPER_KEY_LOCK,
+	QC71D_DETERMINISM_MODE,
+	QC71D_LIGHTBAR_BRIGHTNESS,
+	QC71D_LIGHTBAR_BRIGHTNESS_S3,
+	QC71D_LIGHTBAR_COLOR,
+	QC71D_LIGHTBAR_RAINBOW_MODE,
+	QC71D_BATTERY_CHARGE_END_THRESHOLD,
+	QC71D_FIELD_COUNT
+};
+
+struct qc71d_snapshot {
+	uint64_t timestamp_ns; /* CLOCK_MONOTONIC */
+	uint64_t valid;        /* bitmask of enum qc71d_field */
+	int32_t values[QC71D_FIELD_COUNT]; /* as read from sysfs, temperatures in millidegrees */
+};
+
+struct qc71d_shm {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size; /* sizeof(struct qc71d_shm) */
+	uint32_t interval_ms;
+	_Atomic uint32_t seq; /* odd while the snapshot is being updated */
+	uint32_t reserved;
+	struct qc71d_snapshot snapshot;
+};
+
+/* ========================================================================== */
+/* client library */
+
+struct qc71d_client;
+
+/* 'name' may be NULL, returns NULL and sets errno on failure */
+struct qc71d_client *qc71d_open(const char *name);
+void qc71d_close(struct qc71d_client *client);
+
+/* copies a consistent snapshot, returns 0 on success, -1 with errno set otherwise */
+int qc71d_read(const struct qc71d_client *client, struct qc71d_snapshot *snapshot);
+
+static inline int qc71d_has(const struct qc71d_snapshot *snapshot, enum qc71d_field field)
+{
+	return !!(snapshot->valid & (UINT64_C(1) << field));
+}
+
+#endif /* QC71D_H */
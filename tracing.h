@@ -0,0 +1,126 @@
+// SPDX-License-Identifier: GPL-2.0
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM qc71_laptop
+
+#if !defined(QC71_TRACING_H) || defined(TRACE_HEADER_MULTI_READ)
+#define QC71_TRACING_H
+
+#include <linux/string.h>
+#include <linux/tracepoint.h>
+#include <linux/types.h>
+
+#include "fan.h"
+
+/* ========================================================================== */
+
+#define QC71_LIGHTBAR_FIELD_S0      0
+#define QC71_LIGHTBAR_FIELD_S3      1
+#define QC71_LIGHTBAR_FIELD_COLOR   2
+#define QC71_LIGHTBAR_FIELD_RAINBOW 3
+
+/* ========================================================================== */
+
+TRACE_DEFINE_ENUM(QC71_FAN_MODE_SOURCE_HWMON);
+TRACE_DEFINE_ENUM(QC71_FAN_MODE_SOURCE_DETERMINISM);
+
+TRACE_EVENT(qc71_fan_mode_change,
+	TP_PROTO(int old_mode, int new_mode, enum qc71_fan_mode_source source),
+	TP_ARGS(old_mode, new_mode, source),
+
+	TP_STRUCT__entry(
+		__field(int, old_mode)
+		__field(int, new_mode)
+		__field(int, source)
+	),
+
+	TP_fast_assign(
+		__entry->old_mode = old_mode;
+		__entry->new_mode = new_mode;
+		__entry->source   = source;
+	),
+
+	TP_printk("old=%d new=%d source=%s",
+		  __entry->old_mode, __entry->new_mode,
+		  __print_symbolic(__entry->source,
+				   { QC71_FAN_MODE_SOURCE_HWMON,       "hwmon" },
+				   { QC71_FAN_MODE_SOURCE_DETERMINISM, "determinism" }))
+);
+
+TRACE_EVENT(qc71_fan_pwm_set,
+	TP_PROTO(uint8_t fan, uint8_t requested, uint8_t raw, int err),
+	TP_ARGS(fan, requested, raw, err),
+
+	TP_STRUCT__entry(
+		__field(uint8_t, fan)
+		__field(uint8_t, requested)
+		__field(uint8_t, raw)
+		__field(int, err)
+	),
+
+	TP_fast_assign(
+		__entry->fan       = fan;
+		__entry->requested = requested;
+		__entry->raw       = raw;
+		__entry->err       = err;
+	),
+
+	TP_printk("fan=%u requested=%u raw=%u err=%d",
+		  __entry->fan, __entry->requested, __entry->raw, __entry->err)
+);
+
+TRACE_EVENT(qc71_wmi_event,
+	TP_PROTO(const char *guid, u32 code, u64 latency_ns),
+	TP_ARGS(guid, code, latency_ns),
+
+	TP_STRUCT__entry(
+		__array(char, guid, 37)
+		__field(u32, code)
+		__field(u64, latency_ns)
+	),
+
+	TP_fast_assign(
+		strscpy(__entry->guid, guid, sizeof(__entry->guid));
+		__entry->code       = code;
+		__entry->latency_ns = latency_ns;
+	),
+
+	TP_printk("guid=%s code=%u latency_ns=%llu",
+		  __entry->guid, __entry->code, __entry->latency_ns)
+);
+
+TRACE_EVENT(qc71_lightbar_update,
+	TP_PROTO(int field, unsigned int value, int err),
+	TP_ARGS(field, value, err),
+
+	TP_STRUCT__entry(
+		__field(int, field)
+		__field(unsigned int, value)
+		__field(int, err)
+	),
+
+	TP_fast_assign(
+		__entry->field = field;
+		__entry->value = value;
+		__entry->err   = err;
+	),
+
+	TP_printk("field=%s value=%u err=%d",
+		  __print_symbolic(__entry->field,
+				   { QC71_LIGHTBAR_FIELD_S0,      "brightness" },
+				   { QC71_LIGHTBAR_FIELD_S3,      "brightness_s3" },
+				   { QC71_LIGHTBAR_FIELD_COLOR,   "color" },
+				   { QC71_LIGHTBAR_FIELD_RAINBOW, "rainbow_mode" }),
+		  __entry->value, __entry->err)
+);
+
+#endif /* QC71_TRACING_H */
+
+/* ========================================================================== */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE tracing
+
+#include <trace/define_trace.h>